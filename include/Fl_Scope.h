@@ -50,6 +50,9 @@
 #define FL_SCOPE_SIGNED    0
 #define FL_SCOPE_UNSIGNED  1
 
+/* FL_SCOPE_REDRAW_ALWAYS redraws at most this often per second */
+#define FL_SCOPE_FRAME_RATE 30
+
 class FL_EXPORT Fl_Scope : public Fl_Widget
 {
   int       _x,_y,_w,_h;     /* The draw position */
@@ -59,6 +62,8 @@ class FL_EXPORT Fl_Scope : public Fl_Widget
   
   int ScopeDataSize;
   int ScopeDataPos;
+  int ScopeDataHead;         /* Oldest sample of the scrolling trace */
+  int RedrawPending;         /* A frame capped redraw is scheduled */
   
   Fl_Color _TraceColour;     /* Trace Colour */
   Fl_Color _BackColour;      /* Background Colour */
@@ -67,6 +72,10 @@ class FL_EXPORT Fl_Scope : public Fl_Widget
   int RedrawMode;
   int LineType;
   int DataType;
+
+  int  Store(int);           /* Store a sample, returns 1 if the trace is full */
+  void Changed(int);         /* Request a redraw according to RedrawMode */
+  static void RedrawTimeout(void*);
   
 protected:
 
@@ -118,6 +127,7 @@ public:
   
   //int Add(unsigned char);          /* Add Data to Scope */
   int Add(int);          /* Add Data to Scope */ 
+  int Add(const unsigned char*,int); /* Add a block of Data to Scope */
    
   Fl_Color TraceColour(){return _TraceColour;};
   void     TraceColour(Fl_Color c){_TraceColour=c;};
@@ -0,0 +1,144 @@
+#ifndef BANK_H_
+#define BANK_H_
+/**
+ \defgroup pd_bank prodatum Bank Archive
+ @{
+ */
+#include <vector>
+#include <string>
+#include <stdio.h>
+
+/// file name extension of bank archives
+#define BANK_EXTENSION ".pdbank"
+/// number of index entries of a new bank archive
+#define BANK_INDEX_SIZE 1024
+/// size of the bank archive header in bytes
+#define BANK_HEADER_SIZE 32
+/// size of one index entry in bytes
+#define BANK_ENTRY_SIZE 40
+/// length of the name field of an index entry (including the terminating 0)
+#define BANK_NAME_SIZE 20
+
+/**
+ * checksum of the dumps in bank archives and transfer journals
+ * @param data the data
+ * @param length size of the data in bytes
+ */
+unsigned int bank_checksum(const unsigned char* data, unsigned int length);
+
+/**
+ * identity of a device stored in bank archives
+ * @param identity a string that identifies the device (model, device ID, ROMs)
+ */
+unsigned int bank_device_identity(const std::string& identity);
+
+/**
+ * index entry of a bank archive
+ */
+struct bank_entry
+{
+	/// PRESET or ARP
+	int type;
+	int rom;
+	int slot;
+	char name[BANK_NAME_SIZE];
+	unsigned int offset;
+	unsigned int length;
+	unsigned int checksum;
+};
+
+/**
+ * single file bank archive.
+ * a header (with the device the dumps came from and the number of dead
+ * bytes), an index of (type, ROM, slot, name, offset, length, checksum)
+ * and the concatenated raw dumps. storing a slot again overwrites its dump
+ * if the new one fits, otherwise it is appended and the old one becomes
+ * dead bytes. the archive is compacted when it is closed with too many
+ * dead bytes, and rewritten with a larger index when the index is full.
+ * dumps are read by random access through a memory mapping of the file
+ */
+class Bank_Archive
+{
+	std::string path;
+	FILE* file;
+	bool writable;
+	std::vector<bank_entry> index;
+	unsigned int capacity;
+	unsigned int data_end;
+	/// bytes of replaced dumps
+	unsigned int dead;
+	/// identity of the device the archive belongs to, 0 if unknown
+	unsigned int device;
+	const char* error;
+	/// memory mapping of the file, created on demand
+	mutable unsigned char* map;
+	mutable size_t map_size;
+#ifdef WIN32
+	mutable void* map_handle;
+#endif
+
+	bool read_index();
+	bool write_header(unsigned int count);
+	bool write_entry(int i, const bank_entry& e);
+	bool rewrite(unsigned int new_capacity);
+	bool map_file() const;
+	void unmap_file() const;
+
+public:
+	Bank_Archive();
+	~Bank_Archive();
+	/**
+	 * opens a bank archive
+	 * @param filename path of the archive
+	 * @param writable open for appending. creates the archive if it doesn't exist
+	 * @param device_identity identity of the device we write for (see bank_device_identity()).
+	 * an archive of another device is not opened for writing
+	 * @returns false if the file is not a bank archive or can't be opened (see last_error())
+	 */
+	bool open(const char* filename, bool writable = false, unsigned int device_identity = 0);
+	/// closes the archive, compacting it if much of it is dead
+	void close();
+	/// @returns why the last open() or append() failed
+	const char* last_error() const;
+	/// @returns true if an archive is open
+	bool is_open() const;
+	/// @returns the path of the open archive
+	const std::string& filename() const;
+	/// @returns the number of dumps in the archive
+	int entries() const;
+	/// @returns the index entry \c i
+	const bank_entry* entry(int i) const;
+	/**
+	 * looks up a dump
+	 * @returns the index of the entry or -1 if the archive has no such dump
+	 */
+	int find(int type, int rom, int slot) const;
+	/**
+	 * random access to a dump
+	 * @param i index of the entry
+	 * @returns pointer to the mapped dump or 0 if the checksum doesn't match
+	 */
+	const unsigned char* dump(int i) const;
+	/**
+	 * appends a dump to the archive
+	 * @param type PRESET or ARP
+	 * @param rom rom ID of the dump
+	 * @param slot preset/arp number of the dump
+	 * @param name name of the dump
+	 * @param data dump data
+	 * @param length size of the dump in bytes
+	 * @returns false if the archive could not be written
+	 */
+	bool append(int type, int rom, int slot, const char* name, const unsigned char* data, unsigned int length);
+	/**
+	 * writes all dumps of the archive as single .syx files
+	 * (\c %02d-%04d-%s_PRES.syx and \c _ARP.syx)
+	 * @param dir directory to write to
+	 * @returns the number of files written
+	 */
+	int export_files(const char* dir) const;
+	/// @returns true if \c filename has the bank archive extension
+	static bool is_archive(const char* filename);
+};
+/** @} */
+#endif /* BANK_H_ */
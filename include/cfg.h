@@ -16,6 +16,8 @@
 #define MAX_ARPS 400
 #define MAX_RIFFS 1000
 #include <vector>
+#include <map>
+#include <string>
 
 /**
  * Enum of config options
@@ -62,6 +64,7 @@ enum CONFIG
 	CFG_INB,
 	CFG_KNOB_COLOR1,
 	CFG_KNOB_COLOR2,
+	CFG_DELTA_UPLOAD,
 	NOOPTION
 };
 
@@ -77,6 +80,8 @@ class Cfg
 	char export_dir[PATH_MAX];
 	std::vector<int> defaults;
 	std::vector<int> option;
+	/// calibrated CFG_SPEED settings by MIDI port pair
+	std::map<std::string, int> port_delay;
 
 public:
 	/**
@@ -105,6 +110,18 @@ public:
 	int get_cfg_option(int) const;
 	int get_default(int) const;
 	int getset_default(int);
+	/**
+	 * get the sysex delay setting of a MIDI port pair
+	 * @param ports name of the port pair
+	 * @return CFG_SPEED setting or -1 if there is none for the ports
+	 */
+	int get_port_delay(const char* ports) const;
+	/**
+	 * stores the sysex delay setting of a MIDI port pair
+	 * @param ports name of the port pair
+	 * @param delay CFG_SPEED setting
+	 */
+	void set_port_delay(const char* ports, int delay);
 	void apply(bool colors_only = false);
 };
 
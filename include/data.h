@@ -6,9 +6,15 @@
  @{
  */
 #include <vector>
-#include <deque>
+#include <string>
+#include <stddef.h>
 
 #define DUMP_HEADER_SIZE 36
+/// number of parameter records the undo ring can hold
+#define UNDO_SIZE 4096
+
+class Bank_Archive;
+class Name_Index;
 
 /**
  * Enum for generic name IDs used by the device
@@ -18,6 +24,29 @@ enum
 	ID, PRESET, INSTRUMENT, ARP, SETUP, DEMO, RIFF
 };
 
+/**
+ * get a buffer from the dump pool.
+ * dump buffers (and dump objects) are recycled by size, so loading
+ * thousands of dumps in a bulk transfer doesn't churn the heap
+ * @param size size of the buffer in bytes
+ * @returns pointer to the buffer
+ */
+unsigned char* dump_buffer_alloc(int size);
+/**
+ * give a buffer back to the dump pool.
+ * @param buffer buffer obtained from \c dump_buffer_alloc()
+ * @param size size of the buffer in bytes
+ */
+void dump_buffer_free(unsigned char* buffer, int size);
+/**
+ * checksum of a preset dump that ignores where it came from.
+ * device ID, packet type (open/closed loop), preset number and ROM ID
+ * are left out, so a dump read back from the device compares with its source
+ * @param dump the sysex packets of the dump
+ * @param size size of the dump in bytes
+ */
+unsigned int preset_dump_checksum(const unsigned char* dump, int size);
+
 /**
  * Preset Dump class.
  * holds data and informations of a preset dump
@@ -42,19 +71,44 @@ class Preset_Dump
 	bool data_is_changed;
 	/// raw dump data
 	unsigned char* data;
-	/// undo struct
+	/// undo record
 	struct parameter
 	{
 		int id;
 		int value;
 		int layer;
+		/// true for the first record of a group (one user gesture)
+		bool group;
 	};
-	/// undo stack
-	std::deque<parameter> undo_s;
-	/// redo stack
-	std::deque<parameter> redo_s;
-	/// push undo parameter on stack
+	/**
+	 * undo ring, allocated on the first edit.
+	 * records [0, undo_pos) (counted from undo_first) can be undone,
+	 * records [undo_pos, undo_count) can be redone
+	 */
+	parameter* undo_ring;
+	/// index of the oldest record in the ring
+	int undo_first;
+	/// number of records in the ring
+	int undo_count;
+	/// number of records that can be undone
+	int undo_pos;
+	/// open transactions, see \c begin_undo_group()
+	int undo_depth;
+	/// if true, records are added to the last group
+	bool undo_continue;
+	/// returns the record at position pos (counted from the oldest record)
+	parameter& undo_record(int pos) const;
+	/// returns true if the last undo group contains the parameter
+	bool undo_group_contains(int id, int layer) const;
+	/// append a record to the ring
+	void push_undo(int id, int layer, bool group);
+	/// save current value(s) of a parameter to the undo ring
 	void add_undo(int id, int layer);
+	/**
+	 * swap the values of records [from, to) with the values in the dump,
+	 * send them to the device in one go and update the UI.
+	 */
+	void swap_undo_group(int from, int to);
 	void update_ui_from_xdo(int id, int value, int layer) const;
 	/**
 	 * maps parameter IDs to offset values in the dump
@@ -78,8 +132,24 @@ class Preset_Dump
 	 * @param dst destination layer
 	 */
 	void copy_layer_parameter_range(int start, int end, int src, int dst);
+	/**
+	 * compare the payload of a packet with the same packet of another dump.
+	 * header bytes (device ID, command) and checksums are ignored
+	 * @param other the dump to compare with
+	 * @param packet the packet number (0 = dump header)
+	 * @returns true if the packet payloads are equal
+	 */
+	bool packet_equals(const Preset_Dump* other, int packet) const;
 
 public:
+	/// a changed parameter as returned by \c diff()
+	struct parameter_change
+	{
+		int id;
+		int layer;
+		int old_value;
+		int new_value;
+	};
 	/**
 	 * CTOR for Preset Dump
 	 * @param dump_size the size of the dump in bytes
@@ -93,6 +163,9 @@ public:
 	 * DTOR just frees the memory
 	 */
 	~Preset_Dump();
+	/// dump objects are recycled using the dump pool
+	static void* operator new(size_t size);
+	static void operator delete(void* p, size_t size);
 
 	/// pack the sysex for converted messages
 	void repack_sysex(std::vector<unsigned char>& v, int shift, int dest_size);
@@ -104,6 +177,14 @@ public:
 	void undo();
 	/// redo edit
 	void redo();
+	/**
+	 * start an undo transaction.
+	 * all parameters changed until \c end_undo_group() are undone (and redone)
+	 * at once. transactions may be nested.
+	 */
+	void begin_undo_group();
+	/// end an undo transaction
+	void end_undo_group();
 	/// if true, nothing is pushed on the undo stack
 	bool disable_add_undo;
 	/**
@@ -114,6 +195,8 @@ public:
 	void set_changed(bool);
 	/// returns the preset name
 	const char* get_name() const;
+	/// returns the 16 name characters as stored in the dump
+	const unsigned char* get_name_bytes() const;
 	/// returns the preset number
 	int get_number() const;
 	/// returns the ROM ID
@@ -139,15 +222,25 @@ public:
 	/**
 	 * update UI widgets with the parameter values of this dump.
 	 * this calls \c get_value() for all parameters (except FX parameters)
-	 * and sets the corresponding widget in the UI.
+	 * and sets the widgets whose value differs from what they show.
+	 * piano ranges and envelopes are only rebuilt if they changed
 	 */
 	void show() const;
+	/// number of widgets the last \c show() updated
+	static int widgets_updated();
+	/// makes the next \c show() refresh all widgets
+	static void invalidate_shown();
 	/**
 	 * update UI-FX widgets with the parameter values of this dump.
 	 * this calls \c get_value() for all FX parameters
 	 * and sets the corresponding widget in the UI.
 	 */
 	void show_fx() const;
+	/**
+	 * update the program name display.
+	 * @param changes number of changed parameters to show next to the name
+	 */
+	void show_name(int changes = 0) const;
 	/**
 	 * move preset to a new location.
 	 * @param new_number the new location for the preset
@@ -172,8 +265,36 @@ public:
 	 * the upload was successfull
 	 */
 	void upload(int packet, int closed = -1, bool show = false);
-	/// save dump to disk
-	void save_file(const char* save_dir, int offset=-1);
+	/**
+	 * send only the parameters that differ from another dump to the edit buffer.
+	 * changed parameters are packed into multi-parameter edit messages,
+	 * layer parameters are grouped by layer.
+	 * @param original the dump the device edit buffer was loaded from
+	 * @returns false if the dumps are not comparable or if too many
+	 * parameters have changed (a complete upload is cheaper then)
+	 */
+	bool upload_changes(const Preset_Dump* original) const;
+	/**
+	 * save dump to disk
+	 * @param save_dir directory to save to
+	 * @param offset preset number for the file name, -1 to export the edit buffer
+	 * @param saved receives the path of the file if it was written
+	 */
+	void save_file(const char* save_dir, int offset=-1, std::string* saved=0);
+	/// append dump to a bank archive
+	bool save_archive(Bank_Archive* bank, int offset);
+	/// @returns the \c preset_dump_checksum() of this dump
+	unsigned int normalized_checksum() const;
+	/**
+	 * compare this dump with another dump of the same size.
+	 * walks all parameter IDs (and layers) and collects the ones that differ.
+	 * packets with identical payload are skipped, so this is cheap enough
+	 * to be called after every edit.
+	 * @param original the dump to compare against (usually \c pxk->preset_copy)
+	 * @param changes if not 0, changed parameters are appended to this list
+	 * @returns number of changed parameters or -1 if the dumps are not comparable
+	 */
+	int diff(const Preset_Dump* original, std::vector<parameter_change>* changes = 0) const;
 };
 
 /**
@@ -191,6 +312,9 @@ class Arp_Dump
 public:
 	Arp_Dump(int dump_size, const unsigned char* dump_data, bool editor);
 	~Arp_Dump();
+	/// dump objects are recycled using the dump pool
+	static void* operator new(size_t size);
+	static void operator delete(void* p, size_t size);
 	void update_sequence_length_information() const;
 	int get_number() const;
 	int get_value(int id, int step) const;
@@ -199,7 +323,9 @@ public:
 	void reset_step(int step) const;
 	void reset_pattern() const;
 	void load_file(int num) const;
-	void save_file(const char* save_dir, int offset) const;
+	void save_file(const char* save_dir, int offset, std::string* saved=0) const;
+	/// append dump to a bank archive
+	bool save_archive(Bank_Archive* bank, int offset) const;
 };
 
 /**
@@ -242,6 +368,9 @@ public:
 	 * DTOR just frees the memory
 	 */
 	~Setup_Dump();
+	/// dump objects are recycled using the dump pool
+	static void* operator new(size_t size);
+	static void operator delete(void* p, size_t size);
 	/**
 	 * get the value of a parameter.
 	 * extract a value for a given setup parameter from the dump
@@ -323,6 +452,8 @@ class ROM
 	bool arp_names_changed;
 	/// storage pointer to the array of riff names
 	unsigned char* riff_names;
+	/// filter indexes of the name tables, built on demand
+	Name_Index* name_indexes[RIFF + 1];
 
 public:
 	/**
@@ -369,6 +500,13 @@ public:
 	 * @returns pointer to the name
 	 */
 	const unsigned char* get_name(int type, int number = 0) const;
+	/**
+	 * returns the filter index of a name table.
+	 * the index is built on first use and follows \c set_name()
+	 * @param type of name (PRESET; INSTRUMENT,..)
+	 * @returns the index or 0 if the table is not loaded
+	 */
+	Name_Index* name_index(int type);
 
 	int get_romid();
 };
@@ -0,0 +1,86 @@
+#ifndef JOURNAL_H_
+#define JOURNAL_H_
+/**
+ \defgroup pd_journal prodatum Transfer Journal
+ @{
+ */
+#include <map>
+#include <string>
+#include <stdio.h>
+
+/**
+ * a completed item of a bulk transfer
+ */
+struct journal_entry
+{
+	unsigned int checksum;
+	/// file the dump was saved to (empty for uploads and bank archives)
+	std::string file;
+};
+
+/**
+ * on-disk journal of a bulk transfer.
+ * every completed slot is appended with the checksum of its dump, so an
+ * interrupted job can be restarted and skip what is already done. the
+ * journal starts with the signature of its job (device, files, slots) and
+ * is only resumed by the same job. it is deleted when a job runs to the
+ * end without errors
+ */
+class Transfer_Journal
+{
+	std::string path;
+	FILE* file;
+	std::map<long, journal_entry> completed;
+	bool failed;
+	unsigned int job;
+
+	static long key(int type, int rom, int slot);
+	bool create();
+
+public:
+	Transfer_Journal();
+	~Transfer_Journal();
+	/**
+	 * opens a journal and loads the items of a previous run of the same job.
+	 * the journal of another job is started over
+	 * @param filename path of the journal
+	 * @param signature identifies the job
+	 * @returns false if the journal can't be written
+	 */
+	bool open(const std::string& filename, const std::string& signature);
+	/// number of items completed by a previous run of this job
+	size_t resumable() const;
+	/// forgets the items of the previous run
+	bool restart();
+	/// closes the journal, keeping it on disk
+	void close();
+	bool is_open() const;
+	/**
+	 * records a completed item
+	 * @param type PRESET or ARP
+	 * @param rom rom ID of the slot
+	 * @param slot preset/arp number
+	 * @param checksum checksum of the transferred dump
+	 * @param saved_file the file the dump was saved to
+	 */
+	void add(int type, int rom, int slot, unsigned int checksum, const std::string& saved_file = "");
+	/**
+	 * looks up an item of this or a previous run
+	 * @returns the entry or 0 if the item was not completed
+	 */
+	const journal_entry* find(int type, int rom, int slot) const;
+	/// marks the job as incomplete (an item was skipped)
+	void fail();
+	/// the job ran to the end. closes the journal and deletes it if nothing failed
+	void finish();
+};
+
+/**
+ * checksum of a file
+ * @param filename the file
+ * @param checksum receives the checksum
+ * @returns false if the file can't be read
+ */
+bool file_checksum(const std::string& filename, unsigned int* checksum);
+/** @} */
+#endif /* JOURNAL_H_ */
@@ -118,6 +118,21 @@ public:
 	 * @param timeout time to wait in ms before sending the request
 	 */
 	void request_preset_dump(int timeout = 0) const;
+	/**
+	 * sends an open loop dump request for the edit buffer.
+	 * doesn't touch the request state, the reply must be handled by the caller
+	 * (used by the sysex delay calibration)
+	 */
+	void request_edit_buffer_dump() const;
+	/**
+	 * sends a dump request for a preset slot without selecting it
+	 * (used by the read-back verification of bulk uploads)
+	 * @param number preset number
+	 * @param rom_id rom ID of the preset
+	 */
+	void request_slot_dump(int number, int rom_id) const;
+	/// true while a request waits for its answer
+	bool request_pending() const;
 	/// sends a setup dump request
 	void request_setup_dump() const;
 	//	/// sends an FX dump request
@@ -143,6 +158,28 @@ public:
 	 * @param value the new value for the parameter
 	 */
 	void edit_parameter_value(int id, int value) const;
+	/**
+	 * sends multiple parameter value edits in one (or more) messages.
+	 * parameters are sent in the given order, in chunks of up to
+	 * 41 ID/value pairs per message.
+	 * @param ids the parameter IDs
+	 * @param values the new values for the parameters
+	 * @param count number of parameters
+	 */
+	void edit_parameter_values(const int* ids, const int* values, int count) const;
+	/**
+	 * queues a parameter value edit command.
+	 * queued edits are coalesced (only the latest value per ID and layer is
+	 * kept) and sent as one multi-parameter message when the sender is idle,
+	 * or before any other message is sent. layer select commands are inserted
+	 * only where the device has another layer selected.
+	 * @param id the parameter ID
+	 * @param value the new value for the parameter
+	 * @param layer the layer the edit applies to (-1 = all layers, -2 = layer independent)
+	 */
+	void queue_parameter_value(int id, int value, int layer = -2) const;
+	/// sends all queued parameter value edits
+	void flush_parameter_values() const;
 	/**
 	 * renames an item on the device.
 	 * @param type the type of the item to rename (PRESET or ARP)
@@ -0,0 +1,61 @@
+#ifndef NAMES_H_
+#define NAMES_H_
+/**
+ \defgroup pd_names prodatum Name Index
+ @{
+ */
+#include <map>
+#include <deque>
+#include <vector>
+#include <string>
+
+/// number of filter results a name index keeps
+#define NAME_INDEX_CACHE 16
+
+/**
+ * search index of a ROM name table for the browser filters.
+ * holds the case folded browser rows ("0012 Name") and a trigram index.
+ * recent results are cached, so a query that extends a previous one
+ * only narrows that result. browsers showing the same table share it
+ */
+class Name_Index
+{
+	/// digits of the row numbers
+	int digits;
+	/// case folded rows
+	std::vector<std::string> rows;
+	/// rows containing a trigram, sorted
+	std::map<unsigned int, std::vector<int> > trigrams;
+	struct result
+	{
+		std::string query;
+		std::vector<int> rows;
+	};
+	/// recent results, newest last
+	std::deque<result> cache;
+
+	void index_row(int row, bool add);
+
+public:
+	/**
+	 * @param digits digits of the row numbers (4 for instruments, 3 otherwise)
+	 */
+	Name_Index(int digits);
+	/**
+	 * adds or replaces a row
+	 * @param row number of the name
+	 * @param name the name (up to 16 characters)
+	 */
+	void set(int row, const unsigned char* name);
+	/// @returns the number of rows
+	int size() const;
+	/**
+	 * looks up the rows that contain \c query (ignoring case)
+	 * @returns the sorted row numbers. valid until the next call
+	 */
+	const std::vector<int>& match(const char* query);
+	/// @returns true if \c text contains \c query, ignoring case
+	static bool contains(const char* text, const char* query);
+};
+/** @} */
+#endif /* NAMES_H_ */
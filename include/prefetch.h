@@ -0,0 +1,96 @@
+#ifndef PREFETCH_H_
+#define PREFETCH_H_
+/**
+ \defgroup pd_prefetch prodatum File Prefetcher
+ @{
+ */
+#include <vector>
+#include <deque>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "bank.h"
+
+/// number of files the reader stays ahead of the transmitter
+#define PREFETCH_AHEAD 4
+/// largest dump we read from disk (preset dump)
+#define PREFETCH_BUFFER_SIZE 1615
+
+/**
+ * a file read and validated by the \c File_Prefetcher
+ */
+struct prefetched_file
+{
+	std::string filename;
+	/// sysex data, 0 if the file is not valid
+	unsigned char* sysex;
+	int size;
+	/// packet size of preset dumps
+	int packet_size;
+	/// status message if the file is not valid
+	const char* error;
+};
+
+/**
+ * background reader for bulk imports.
+ * opens, validates and decodes the next files of a file list on its own
+ * thread, so the uploader only takes already validated dumps from a queue
+ * and the UI thread never waits for the disk between MIDI transmissions
+ */
+class File_Prefetcher
+{
+	std::thread reader;
+	mutable std::mutex lock;
+	std::condition_variable changed;
+	std::deque<prefetched_file> ready;
+	/// recycled buffers of PREFETCH_BUFFER_SIZE bytes
+	std::vector<unsigned char*> buffers;
+	std::vector<std::string> files;
+	size_t next_file;
+	size_t taken;
+	size_t ahead;
+	/// dump type to validate (PRESET, ARP or SETUP)
+	int type;
+	bool stopping;
+	/// the bank archive we read entries from (reader thread only)
+	Bank_Archive archive;
+
+	void run();
+	void read_file(const std::string& filename, prefetched_file* f, unsigned char* buffer);
+	void stop_reader();
+
+public:
+	File_Prefetcher();
+	~File_Prefetcher();
+	/**
+	 * starts reading a list of files
+	 * @param file_list the files in upload order
+	 * @param dump_type PRESET, ARP or SETUP
+	 * @param read_ahead number of files to keep validated in the queue
+	 */
+	void start(const std::vector<std::string>& file_list, int dump_type, size_t read_ahead = PREFETCH_AHEAD);
+	/**
+	 * takes the next file from the queue. waits for the reader if it
+	 * didn't get there yet
+	 * @param f receives the file. pass it to \c release() when done
+	 * @returns false if there are no more files
+	 */
+	bool next(prefetched_file* f);
+	/// gives the buffer of a file taken with \c next() back to the reader
+	void release(prefetched_file* f);
+	/// stops reading and drops all queued files
+	void stop();
+	/// number of files not taken yet
+	size_t remaining() const;
+	/**
+	 * name of an entry of a bank archive in a file list
+	 * @param archive path of the archive
+	 * @param entry index of the entry
+	 */
+	static std::string archive_entry(const std::string& archive, int entry);
+	/// strips what the file chooser adds to a file name
+	static std::string local_path(const std::string& filename);
+};
+/** @} */
+#endif /* PREFETCH_H_ */
@@ -89,6 +89,7 @@ public:
 	void incoming_NAK(int);
 //	void incoming_ERROR(int, int);
 	void widget_callback(int, int, int layer = -2);
+	void update_dependencies(int, int, int);
 	void cc_callback(int, int);
 	void display_status(const char*);
 	void Join();
@@ -168,17 +169,45 @@ private:
 public:
 	Preset_Dump* preset;
 	const Preset_Dump* preset_copy;
+	/// number of parameters that differ between preset and preset_copy
+	int changed_parameters;
+	void update_change_count();
 	int test_checksum(const unsigned char*, int, int);
 	void show_preset();
 	int selected_layer;
 	void mute(int state, int layer);
+	/// keeps a volume change of a muted layer until it gets unmuted
+	bool hold_muted_volume(int layer, int value);
 	void solo(int state, int layer);
 	void incoming_preset_dump(const unsigned char*, int, bool=false);
+	/// called when the device finished sending a preset dump
+	void preset_dump_complete();
 	void load_export(const char*);
 	void start_over();
 	void randomize();
 	void bulk_preset_download();
 	void bulk_preset_upload();
+	/// called when the last packet (or EOF) of a bulk uploaded preset was sent
+	void preset_upload_complete();
+	/// called when the device answered after a bulk uploaded preset
+	void preset_upload_settled();
+	/**
+	 * finds the fastest reliable sysex delay for the connected device and ports.
+	 * requests names and the edit buffer at decreasing delays and compares the replies
+	 * @param revalidate only check the current setting and go slower until it is reliable
+	 */
+	void calibrate_delay(bool revalidate = false);
+	/// true while a calibration is running (it takes name and preset dump replies)
+	bool calibrating() const;
+	void incoming_calibration(const unsigned char* sysex, int len);
+	/// reports a failed transfer. re-validates the sysex delay if they pile up
+	void transfer_error();
+	/// name of the MIDI port pair we are connected to
+	std::string port_key() const;
+	/// identifies the connected device (port pair, device ID and model) in job journals
+	std::string device_key() const;
+	/// identifies the connected device by model, device ID and ROMs (bank archives)
+	std::string device_identity() const;
 	int get_preset_and_increment();
 
 	/*
@@ -190,6 +219,8 @@ private:
 public:
 	Arp_Dump* arp;
 	void incoming_arp_dump(const unsigned char*, int);
+	/// true while a bulk arp transfer waits for arp dumps it requested
+	bool arp_transfer_pending() const;
 	int get_arp_and_increment();
 
 public:
@@ -201,6 +232,12 @@ public:
 
 	void bulk_pattern_download();
 	void bulk_pattern_upload();
+	/// writes the dumps of a bank archive as single files into the export dir
+	void extract_bank_archive();
+	/// writes the statistics of the finished transfer jobs as CSV or JSON
+	void export_telemetry();
+	/// writes the message log as text
+	void export_log();
 };
 
 #endif /* PXK_H_ */
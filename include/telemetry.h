@@ -0,0 +1,112 @@
+#ifndef TELEMETRY_H_
+#define TELEMETRY_H_
+/**
+ \defgroup pd_telemetry prodatum Transfer Telemetry
+ @{
+ */
+#include <map>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <time.h>
+
+/// number of finished jobs we keep
+#define TELEMETRY_HISTORY 1000
+
+/**
+ * statistics of a finished transfer job
+ */
+struct telemetry_record
+{
+	std::string job;
+	/// wall clock start of the job
+	time_t started;
+	/// duration in seconds
+	double seconds;
+	unsigned long bytes_out;
+	unsigned long bytes_in;
+	unsigned long messages_out;
+	unsigned long messages_in;
+	/// completed items (names, presets, patterns)
+	unsigned int items;
+	unsigned int retries;
+	unsigned int timeouts;
+	/// item latency percentiles in ms
+	double latency_p50;
+	double latency_p90;
+	double latency_p99;
+	double latency_max;
+	/// false if the job was cancelled or failed
+	bool completed;
+};
+
+/**
+ * throughput, retry and latency statistics of long running transfers
+ * (sync, bulk down- and uploads, single preset loads and saves).
+ * the running job feeds the progress window, finished jobs are kept for
+ * the session and can be exported as CSV or JSON
+ */
+class Transfer_Telemetry
+{
+	typedef std::chrono::steady_clock clock;
+	telemetry_record current;
+	bool active;
+	clock::time_point start_time;
+	clock::time_point last_item;
+	/// request times of items in flight
+	std::map<int, clock::time_point> pending;
+	/// item latencies of the running job in ms
+	std::vector<double> latencies;
+	std::vector<telemetry_record> history;
+
+	double elapsed() const;
+
+public:
+	Transfer_Telemetry();
+	/**
+	 * starts a job. a job that is still running is finished as cancelled
+	 * @param job name of the job
+	 */
+	void start(const char* job);
+	/**
+	 * finishes the running job and adds it to the history
+	 * @param completed false if the job was cancelled or failed
+	 */
+	void finish(bool completed);
+	/// @returns true while a job is running
+	bool running() const;
+	/// a message of \c bytes was sent
+	void sent(unsigned int bytes);
+	/// a message of \c bytes was received
+	void received(unsigned int bytes);
+	/**
+	 * an item was requested or sent
+	 * @param key preset/arp number, identifies the item in \c item_done()
+	 */
+	void item_started(int key);
+	/**
+	 * an item completed. its latency is measured from \c item_started() or,
+	 * without one, from the previous item
+	 */
+	void item_done(int key = -1);
+	void retry();
+	void timeout();
+	/**
+	 * live statistics of the running job for the progress window
+	 * @param done items done in the current phase
+	 * @param total items of the current phase (for the ETA)
+	 */
+	std::string summary(double done, double total) const;
+	/// one line report of a finished job
+	static std::string report(const telemetry_record& r);
+	/// @returns the last finished job or 0
+	const telemetry_record* last() const;
+	/// @returns the number of finished jobs
+	size_t jobs() const;
+	/// writes all finished jobs as CSV
+	bool export_csv(const char* filename) const;
+	/// writes all finished jobs as JSON
+	bool export_json(const char* filename) const;
+};
+/** @} */
+#endif /* TELEMETRY_H_ */
@@ -0,0 +1,85 @@
+#ifndef TRAFFIC_H_
+#define TRAFFIC_H_
+/**
+ \defgroup pd_traffic prodatum Traffic Log
+ @{
+ */
+#include <deque>
+#include <vector>
+#include <string>
+#include <chrono>
+
+/// record types of the traffic log
+enum
+{
+	LOG_SYSEX_IN, LOG_SYSEX_OUT, LOG_EVENT_IN, LOG_EVENT_OUT
+};
+
+/**
+ * a logged MIDI message. the bytes are in the ring of the log
+ */
+struct log_record
+{
+	/// seconds since the log was created
+	double time;
+	/// running number of the message per type
+	unsigned int number;
+	/// position of the first byte in the ring
+	unsigned int offset;
+	unsigned int length;
+	unsigned char type;
+};
+
+/**
+ * binary log of the MIDI traffic.
+ * messages are stored raw in a fixed size ring of bytes, the oldest
+ * messages are dropped when it is full. text is rendered on demand,
+ * for the lines that are shown and for exports
+ */
+class Traffic_Log
+{
+	typedef std::chrono::steady_clock clock;
+	std::vector<unsigned char> ring;
+	/// next write position in the ring
+	unsigned int head;
+	/// bytes used in the ring
+	unsigned int used;
+	std::deque<log_record> records;
+	/// number of records dropped or cleared so far
+	unsigned long dropped;
+	unsigned int count[4];
+	clock::time_point start;
+	void (*changed_cb)(void*);
+	void* changed_data;
+
+	int prefix(const log_record& r, char* buf, int len) const;
+
+public:
+	/**
+	 * @param size size of the ring in bytes
+	 */
+	Traffic_Log(unsigned int size);
+	/**
+	 * logs a message
+	 * @param type one of LOG_SYSEX_IN, LOG_SYSEX_OUT, LOG_EVENT_IN, LOG_EVENT_OUT
+	 * @param data the message
+	 * @param len size of the message in bytes
+	 */
+	void add(unsigned char type, const unsigned char* data, unsigned int len);
+	/// drops all records
+	void clear();
+	/// @returns the number of records in the log
+	size_t size() const;
+	/// @returns the serial number of the oldest record
+	unsigned long first() const;
+	/// @returns the length of the text of record \c i without rendering it
+	size_t text_length(size_t i) const;
+	/// renders record \c i, e.g. "12.345 I.7::F0180F..."
+	std::string text(size_t i) const;
+	/// writes the log as text, one record per line
+	bool export_text(const char* filename) const;
+	/// sets a function that is called whenever records were added or dropped
+	void callback(void (*cb)(void*), void* data);
+};
+/** @} */
+#endif /* TRAFFIC_H_ */
@@ -37,6 +37,7 @@
 
 #include <FL/Fl_Double_Window.H>
 #include <FL/Fl_Hold_Browser.H>
+#include <FL/Fl_Browser_.H>
 #include <FL/Fl_Choice.H>
 #include <FL/Fl_Input.H>
 #include <FL/Fl_Input_Choice.H>
@@ -50,9 +51,14 @@
 #include <FL/Fl_Button.H>
 #include <FL/Fl_Box.H>
 #include <FL/Fl_Text_Display.H>
+#include <FL/Fl_Scrollbar.H>
 #include <FL/Fl_Tooltip.H>
+#include <FL/x.H>
+#include <deque>
+#include <vector>
 
 #include "config.h"
+#include "traffic.h"
 
 /**
  * maps filter parameter values to index in selectors array.
@@ -132,6 +138,49 @@ public:
 
 extern PWid* pwid[2000][4];
 extern PWid* pwid_editing;
+
+/// widget groups of the parameter registry
+enum
+{
+	PWID_PRESET, PWID_LAYER, PWID_SETUP, PWID_FX_MASTER, PWID_FX_PRESET, PWID_GROUPS
+};
+
+/**
+ * a registered parameter widget
+ */
+struct pwid_entry
+{
+	int id;
+	int layer;
+	PWid* widget;
+};
+
+/**
+ * dense index of the \c pwid[][] array.
+ * holds the registered widgets of each group sorted by ID and layer, so
+ * the dumps walk the existing parameter widgets instead of ID ranges:
+ * - PWID_PRESET: preset common parameters 915-1300 (without FX)
+ * - PWID_LAYER: preset layer parameters 1409-1992 (all 4 layers)
+ * - PWID_SETUP: setup parameters 130-787 (without FX)
+ * - PWID_FX_MASTER, PWID_FX_PRESET: FX parameters 513-528 and 1153-1168
+ *   (the FX widgets are registered with one set at a time)
+ */
+class PWid_Registry
+{
+	std::vector<pwid_entry> groups[PWID_GROUPS];
+	void add(int group, int first, int last, int layers);
+public:
+	/// builds all groups from \c pwid[][]. call once the UI is constructed
+	void build();
+	/// rebuilds the FX groups after the FX widgets switched between master and preset IDs
+	void build_fx();
+	/// @returns the widgets of a group
+	const std::vector<pwid_entry>& group(int g) const
+	{
+		return groups[g];
+	}
+};
+extern PWid_Registry pwid_registry;
 // some often used toltips
 static const char* _ms = "Modulation Source";
 static const char* _md = "Modulation Destination";
@@ -178,10 +227,12 @@ protected:
 
 /**
  * Browser class.
- * adds a filter and a name loader method (load_n) to the Fl_Browser class.
- * also adds "right-click to reset to initial" support
+ * a virtual list of a ROM name table. rows are formatted from the table
+ * when they are drawn, so loading a table or switching ROMs costs nothing.
+ * adds a filter, a name loader method (load_n) and "right-click to reset
+ * to initial" support. the interface follows Fl_Hold_Browser
  */
-class Browser: public Fl_Hold_Browser, public PWid
+class Browser: public Fl_Browser_, public PWid
 {
 	/// current filter string
 	char* filter;
@@ -189,13 +240,36 @@ class Browser: public Fl_Hold_Browser, public PWid
 	int handle(int event);
 	/// local memory of the ROM ID that we have currently loaded
 	int selected_rom;
+	/// name type of the loaded list (PRESET, INSTRUMENT,..)
+	int selected_type;
+	/// true if some rows are hidden by the filter
+	bool filtered;
+	/// visible rows while filtered, sorted
+	std::vector<int> shown;
+	/// the last formatted row
+	mutable char row_text[24];
+	/// the preset link browsers have an "Off" row before the names
+	bool has_off_row() const;
+	// virtual list
+	void* item_first() const;
+	void* item_last() const;
+	void* item_next(void* item) const;
+	void* item_prev(void* item) const;
+	int item_height(void* item) const;
+	int item_width(void* item) const;
+	void item_draw(void* item, int X, int Y, int W, int H) const;
+	int full_height() const;
 public:
 	Browser(int x, int y, int w, int h, char* const label = 0) :
-			Fl_Hold_Browser(x, y, w, h, label)
+			Fl_Browser_(x, y, w, h, label)
 	{
 		filter = 0;
+		type(FL_HOLD_BROWSER);
 		has_scrollbar(VERTICAL);
 		selected_rom = -1;
+		selected_type = -1;
+		filtered = false;
+		row_text[0] = '\0';
 	}
 	void set_id(int v, int l = 0);
 	void set_value(int v);
@@ -209,6 +283,22 @@ public:
 		minimax[1] = size() - 1;
 		return minimax;
 	}
+	/// @returns the number of rows
+	int size() const;
+	/// @returns the selected row or 0
+	int value() const;
+	/// selects a row
+	void value(int line)
+	{
+		select(line);
+	}
+	/**
+	 * selects or deselects a row
+	 * @returns 1 if the selection changed
+	 */
+	int select(int line, int val = 1);
+	/// @returns the text of a row, valid until the next call
+	const char* text(int line) const;
 };
 
 /**
@@ -382,7 +472,9 @@ public:
 
 /**
  * Fl_Knob class.
- * adds "right-click to reset to initial" and mousewheel support
+ * adds "right-click to reset to initial" and mousewheel support.
+ * knob bodies are rendered once per size, scale and state and shared by
+ * all knobs, only the cursor is drawn live
  */
 class Fl_Knob: public Fl_Valuator, public PWid
 {
@@ -392,6 +484,7 @@ class Fl_Knob: public Fl_Valuator, public PWid
 	short a1, a2;
 	void draw();
 	int handle(int event);
+	void draw_body(const int side, const char state);
 	void draw_scale(const int ox, const int oy, const int side);
 	void draw_cursor(const int ox, const int oy, const int side);
 	void shadow(const int offs, const uchar r, uchar g, uchar b);
@@ -403,6 +496,8 @@ public:
 	void set_id(int v, int l = 0);
 	void set_value(int);
 	int get_value() const;
+	/// drops the rendered knob bodies (call after the colors changed)
+	static void clear_sprites();
 };
 
 /**
@@ -574,12 +669,31 @@ class Envelope_Editor: public Fl_Box
 		SHAPE_C,
 		SHAPE_D
 	};
+	/**
+	 * everything the static parts of the editor depend on. the background
+	 * is rendered again when this changes
+	 */
+	struct background_state
+	{
+		int w, h;
+		Fl_Color colors[6];
+		envelope env[3];
+		unsigned char mode, zoomlevel;
+		char button_hover;
+		bool overlay, syncview, active, button_push;
+	};
 	virtual int handle(int event);
 	void draw();
 	void draw_b_label(char, Fl_Color);
 	void draw_envelope(unsigned char type, int x0, int y0, int luma);
+	void draw_background(int x, int y);
+	void get_background_state(background_state* s);
+	void layout(int x, int y);
 	void copy_envelope(unsigned char src, unsigned char dst);
 	void set_shape(unsigned char dst, char shape);
+	/// box, grid, buttons and the inactive envelopes
+	Fl_Offscreen background;
+	background_state background_drawn;
 	char layer;
 	int ee_x0;
 	int ee_y0;
@@ -604,6 +718,7 @@ public:
 	Envelope_Editor(int x, int y, int w, int h, char* const label = 0) :
 			Fl_Box(x, y, w, h, label)
 	{
+		background = 0;
 		zoomlevel = 4;
 		modes = 3;
 		mode = VOLUME;
@@ -614,6 +729,7 @@ public:
 		set_shape(FILTER, SHAPE_A);
 		set_shape(AUXILIARY, SHAPE_C);
 	}
+	~Envelope_Editor();
 	void set_data(unsigned char type, int* stages, char mode, char repeat);
 	void set_layer(char l);
 	void sync_view(char l, char m = 0, float z = .0, bool o = false);
@@ -629,10 +745,13 @@ class Piano: public Fl_Box
 	virtual int handle(int event);
 	void draw();
 	void draw_ranges();
+	void render_ranges();
 	void draw_piano();
 	void draw_highlights();
 	void draw_case();
 	void draw_curve(int type);
+	void translate(int dx, int dy);
+	void damage_key(int key);
 	void switch_mode();
 	void commit_changes();
 	void calc_hovered(int x, int y);
@@ -672,10 +791,19 @@ class Piano: public Fl_Box
 	char key_velocity;
 	Fl_Color color_white;
 	Fl_Color color_black;
+	/// rendered ranges and curves, relative to the top left of their area
+	Fl_Offscreen ranges_cache;
+	int ranges_w, ranges_h;
+	bool ranges_valid;
+	unsigned char ranges_mode, ranges_eall;
+	unsigned int ranges_colors[3];
 public:
 	Piano(int x, int y, int w, int h, char* const label = 0) :
 			Fl_Box(x, y, w, h, label)
 	{
+		ranges_cache = 0;
+		ranges_w = ranges_h = 0;
+		ranges_valid = false;
 		color_white = FL_FOREGROUND_COLOR;
 		color_black = FL_BACKGROUND_COLOR;
 		// tasten- h�hen/-breiten
@@ -765,6 +893,7 @@ public:
 	void set_transpose(char l1, char l2, char l3, char l4);
 	void select_transpose_layer(char l);
 	void set_mode(char m);
+	~Piano();
 	void activate_key(char value, unsigned char key);
 	void reset_active_keys();
 };
@@ -780,6 +909,7 @@ class MiniPiano: public Fl_Box
 	void draw_piano();
 	void draw_highlights();
 	void draw_case();
+	void damage_key(int key);
 	void calc_hovered(int x, int y);
 	void shift_octave(int);
 
@@ -956,5 +1086,63 @@ public:
 		wrap_mode(1, w / c_w - 4);
 	}
 };
+
+// ###################
+//
+// ###################
+/**
+ * message log window display.
+ * shows a \c Traffic_Log and renders the hex text only for the records
+ * that are scrolled into view. long messages wrap at the window width
+ */
+class Log_Display: public Fl_Group
+{
+	Traffic_Log* traffic;
+	Fl_Scrollbar* scrollbar;
+	Fl_Color text_color;
+	int c_w;
+	int l_h;
+	int columns;
+	/// absolute row after the last row of each record
+	std::deque<unsigned long> row_end;
+	/// absolute first row of the oldest record
+	unsigned long row_base;
+	/// serial number of the oldest record
+	unsigned long first_serial;
+	/// absolute first visible row
+	unsigned long top;
+	/// serial numbers of the selected records (anchor and end), -1 if none
+	long sel_anchor, sel_end;
+	/// changes of the log wait for the next frame
+	bool update_pending, update_follow;
+	int handle(int event);
+	void draw();
+	int rows_visible() const;
+	unsigned long rows_of(size_t record) const;
+	void sync();
+	void rebuild();
+	void update_scrollbar();
+	void scroll(long rows);
+	long record_at(int Y) const;
+	/// copies the text of the selected records, to the clipboard if \c clipboard is 1
+	void copy_selection(int clipboard) const;
+	static void cb_scrollbar(Fl_Widget*, void*);
+	static void cb_update(void*);
+public:
+	Log_Display(int x, int y, int w, int h, char const* label = 0);
+	~Log_Display();
+	void resize(int X, int Y, int W, int H);
+	/// sets the log to show
+	void source(Traffic_Log* log);
+	/**
+	 * takes over added and dropped records of the log, at most once per frame
+	 * @param follow scroll to the end
+	 */
+	void changed(bool follow);
+	void textcolor(Fl_Color c)
+	{
+		text_color = c;
+	}
+};
 #endif /* WIDGETS_H_ */
 /** @} */
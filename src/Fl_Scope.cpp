@@ -40,6 +40,12 @@
 ************************************************************
 *                  Version Information
 ************************************************************
+* V0.2.0
+*  Scrolling trace is a ring buffer instead of moving the data
+*  Add(const unsigned char*,int) adds a block of data
+*  FL_SCOPE_REDRAW_ALWAYS redraws at most FL_SCOPE_FRAME_RATE times
+*  per second
+************************************************************
 * V0.1.0 - 14 February 2005
 * Lots of changes:
 *  Different Redraw modes added
@@ -71,10 +77,10 @@ void Fl_Scope::draw()
 
 void Fl_Scope::draw(int xx, int yy, int ww, int hh)
 {
- //unsigned char *Ptr,*Ptr2;
- int *Ptr,*Ptr2;
+ int Sample,Sample2;
  int count;
  int Yval,Yval2;
+ int Len=ScopeDataSize+1;
 
  /* Push clip for drawing */
  fl_push_clip(xx,yy,ww,hh);
@@ -84,12 +90,11 @@ void Fl_Scope::draw(int xx, int yy, int ww, int hh)
 
  fl_color(_TraceColour);
  
- /* Draw the scope Data */
- Ptr2=Ptr=ScopeData;
- Ptr2++;
+ /* Draw the scope Data, oldest first */
  for(count=0;count<ScopeDataSize-1;count++)
  {
- 
+  Sample=ScopeData[(ScopeDataHead+count)%Len];
+  Sample2=ScopeData[(ScopeDataHead+count+1)%Len];
    
   switch(LineType)
   {
@@ -98,12 +103,12 @@ void Fl_Scope::draw(int xx, int yy, int ww, int hh)
     //fl_line(xx,(yy+hh) - (int)((float)*Ptr * ((float)hh/255.0)),xx+1,(yy+hh) - (int)((float)*Ptr2 * ((float)hh/255.0)) );
     if(DataType==FL_SCOPE_UNSIGNED)
     {
-     fl_line(xx,(yy+hh) - (int)((float)*Ptr * ((float)hh/MAX)),xx+1,(yy+hh) - (int)((float)*Ptr2 * ((float)hh/MAX)) );
+     fl_line(xx,(yy+hh) - (int)((float)Sample * ((float)hh/MAX)),xx+1,(yy+hh) - (int)((float)Sample2 * ((float)hh/MAX)) );
     }
     else
     {
-     Yval=(int) (  (float)((int)*Ptr) * (float)hh/(MAX/2.0));
-     Yval2=(int) (  (float)((int)*Ptr2) * (float)hh/(MAX/2.0));
+     Yval=(int) (  (float)Sample * (float)hh/(MAX/2.0));
+     Yval2=(int) (  (float)Sample2 * (float)hh/(MAX/2.0));
      fl_line(xx,(yy+(hh/2)) - Yval,xx+1,(yy+(hh/2)) - Yval2 );
     }
     break;
@@ -111,19 +116,17 @@ void Fl_Scope::draw(int xx, int yy, int ww, int hh)
    case FL_SCOPE_DOT:
     if(DataType==FL_SCOPE_UNSIGNED)
     {
-     fl_point(xx,(yy+hh) - (int)((float)*Ptr * ((float)hh/MAX)) );
+     fl_point(xx,(yy+hh) - (int)((float)Sample * ((float)hh/MAX)) );
     }
     else
     {
-     Yval=(int) (  (float)((int)*Ptr) * (float)hh/(MAX/2.0));
+     Yval=(int) (  (float)Sample * (float)hh/(MAX/2.0));
      fl_point(xx,(yy+(hh/2)) - Yval);
     }
     break;  
     
   }
   xx++;
-  Ptr2++;
-  Ptr++;
  }
 
  
@@ -134,13 +137,11 @@ void Fl_Scope::draw(int xx, int yy, int ww, int hh)
 
 
 /*******************************************************
-*               Fl_Scope::Add
+*               Fl_Scope::Store
 *******************************************************/
-//int Fl_Scope::Add(unsigned char data)
-int Fl_Scope::Add(int data)
+int Fl_Scope::Store(int data)
 {
- //unsigned char *Ptr,*Ptr2;
- int *Ptr,*Ptr2;
+ int *Ptr;
  int count;
  
  
@@ -150,15 +151,9 @@ int Fl_Scope::Add(int data)
  {
    default:
    case FL_SCOPE_TRACE_SCROLL:
-    /* Move Data to left then add data at the end */
-    Ptr=Ptr2=ScopeData;
-    Ptr2++;
-    for(count=0;count<ScopeDataSize;count++)
-    {
-     *Ptr=*Ptr2;
-      Ptr++;Ptr2++;
-    }
-    *Ptr=data;
+    /* Overwrite the oldest sample, the next one becomes the oldest */
+    ScopeData[ScopeDataHead]=data;
+    ScopeDataHead=(ScopeDataHead+1)%(ScopeDataSize+1);
     break;
  
   case FL_SCOPE_TRACE_LOOP_CLEAR:
@@ -174,6 +169,7 @@ int Fl_Scope::Add(int data)
      
   case FL_SCOPE_TRACE_LOOP:
    /* Insert data, and once at end loop back to the start */
+   ScopeDataHead=0;
    Ptr=ScopeData;
    Ptr+=ScopeDataPos;
    *Ptr=data;
@@ -183,24 +179,90 @@ int Fl_Scope::Add(int data)
  
  ScopeDataPos++;
  
+ return(ScopeDataPos == ScopeDataSize);
+}
+
+
+
+/*******************************************************
+*               Fl_Scope::Changed
+*******************************************************/
+void Fl_Scope::Changed(int full)
+{
  switch(RedrawMode)
  {
   case FL_SCOPE_REDRAW_OFF:
    break;
   
   case FL_SCOPE_REDRAW_FULL:
-   if(ScopeDataPos == ScopeDataSize) redraw();
+   if(full) redraw();
    break;
  
   default:
   case FL_SCOPE_REDRAW_ALWAYS:
-   redraw();
+   /* Redraw once per frame, no matter how much data arrives */
+   if(!RedrawPending)
+   {
+    RedrawPending=1;
+    Fl::add_timeout(1.0/FL_SCOPE_FRAME_RATE,RedrawTimeout,this);
+   }
    break;
  }
+}
+
+
+
+void Fl_Scope::RedrawTimeout(void *p)
+{
+ Fl_Scope *Scope=(Fl_Scope*)p;
+ Scope->RedrawPending=0;
+ Scope->redraw();
+}
+
+
+
+/*******************************************************
+*               Fl_Scope::Add
+*******************************************************/
+//int Fl_Scope::Add(unsigned char data)
+int Fl_Scope::Add(int data)
+{
+ Changed(Store(data));
+ return(1); 
+}
+
+
+
+/*******************************************************
+*               Fl_Scope::Add
+*
+* Adds n samples at once and redraws once.
+*******************************************************/
+int Fl_Scope::Add(const unsigned char *data,int n)
+{
+ int full=0;
+ int Len=ScopeDataSize+1;
  
+ if(n<=0) return(0);
  
-  
- return(1); 
+ /* Samples that would scroll out right away are skipped */
+ if(TraceType==FL_SCOPE_TRACE_SCROLL && n > Len)
+ {
+  if(ScopeDataPos > ScopeDataSize)ScopeDataPos=0;
+  ScopeDataPos=(ScopeDataPos+n-Len)%Len;
+  full=1;
+  data+=n-Len;
+  n=Len;
+ }
+ 
+ while(n--)
+ {
+  if(Store(*data++)) full=1;
+ }
+ 
+ Changed(full);
+ 
+ return(1);
 }
 
 
@@ -303,6 +365,10 @@ Fl_Scope::Fl_Scope(int X, int Y, int W, int H, const char *l)
 
  ScopeDataPos=0;
  
+ ScopeDataHead=0;
+ 
+ RedrawPending=0;
+ 
  /* Make Scope trace a scrolling type */
  tracetype(FL_SCOPE_TRACE_SCROLL);
 
@@ -325,6 +391,7 @@ Fl_Scope::Fl_Scope(int X, int Y, int W, int H, const char *l)
 ******************************************************/
 Fl_Scope::~Fl_Scope()
 {
+ Fl::remove_timeout(RedrawTimeout,this);
  free(ScopeData); /* Free the scope data */
 }
 
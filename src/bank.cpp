@@ -0,0 +1,501 @@
+/*
+ This file is part of prodatum.
+ Copyright 2011-2015 Jan Eidtmann
+
+ prodatum is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ prodatum is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with prodatum.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <algorithm>
+#include <cctype>
+#ifdef WIN32
+#	include <windows.h>
+#else
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#	include <fcntl.h>
+#	include <unistd.h>
+#endif
+
+#include "config.h"
+#include "data.h"
+#include "bank.h"
+#include "debug.h"
+
+static const char bank_magic[8] =
+	{ 'P', 'D', 'B', 'A', 'N', 'K', 0, 0 };
+static const unsigned int bank_version = 2;
+/// compact the archive on close if more than 1/BANK_DEAD_SHARE of it is dead
+#define BANK_DEAD_SHARE 4
+
+// the archive is little endian on all platforms
+static void put32(unsigned char* p, unsigned int v)
+{
+	p[0] = v & 0xff;
+	p[1] = (v >> 8) & 0xff;
+	p[2] = (v >> 16) & 0xff;
+	p[3] = (v >> 24) & 0xff;
+}
+
+static unsigned int get32(const unsigned char* p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int) p[3] << 24);
+}
+
+// FNV-1a
+unsigned int bank_checksum(const unsigned char* data, unsigned int length)
+{
+	unsigned int h = 2166136261u;
+	for (unsigned int i = 0; i < length; i++)
+	{
+		h ^= data[i];
+		h *= 16777619u;
+	}
+	return h;
+}
+
+unsigned int bank_device_identity(const std::string& identity)
+{
+	unsigned int id = bank_checksum((const unsigned char*) identity.data(), identity.size());
+	// 0 is "unknown"
+	return id ? id : 1;
+}
+
+Bank_Archive::Bank_Archive() :
+		file(0), writable(false), capacity(0), data_end(0), dead(0), device(0), error(""), map(0), map_size(0)
+{
+#ifdef WIN32
+	map_handle = 0;
+#endif
+}
+
+Bank_Archive::~Bank_Archive()
+{
+	close();
+}
+
+bool Bank_Archive::is_archive(const char* filename)
+{
+	size_t l = strlen(filename);
+	size_t e = strlen(BANK_EXTENSION);
+	// ignore trailing white space of chooser values
+	while (l > 0 && isspace((unsigned char) filename[l - 1]))
+		--l;
+	if (l < e)
+		return false;
+	for (size_t i = 0; i < e; i++)
+		if (tolower((unsigned char) filename[l - e + i]) != BANK_EXTENSION[i])
+			return false;
+	return true;
+}
+
+bool Bank_Archive::open(const char* filename, bool writable_, unsigned int device_identity)
+{
+	pmesg("Bank_Archive::open(%s, %d)\n", filename, writable_);
+	close();
+	path = filename;
+	writable = writable_;
+	file = fopen(filename, writable ? "r+b" : "rb");
+	if (file)
+	{
+		if (!read_index())
+		{
+			close();
+			error = "not a bank archive";
+			return false;
+		}
+		if (writable && device_identity)
+		{
+			if (device && device != device_identity)
+			{
+				close();
+				error = "the archive belongs to another device";
+				return false;
+			}
+			// archives of version 1 didn't know their device
+			if (!device)
+			{
+				device = device_identity;
+				write_header(index.size());
+			}
+		}
+		return true;
+	}
+	if (!writable)
+	{
+		error = "can't open the file";
+		return false;
+	}
+	// create a new archive
+	file = fopen(filename, "w+b");
+	if (!file)
+	{
+		error = "can't create the file";
+		return false;
+	}
+	capacity = BANK_INDEX_SIZE;
+	data_end = BANK_HEADER_SIZE + capacity * BANK_ENTRY_SIZE;
+	dead = 0;
+	device = device_identity;
+	index.clear();
+	// reserve the index
+	unsigned char empty[BANK_ENTRY_SIZE];
+	memset(empty, 0, BANK_ENTRY_SIZE);
+	fseek(file, BANK_HEADER_SIZE, SEEK_SET);
+	for (unsigned int i = 0; i < capacity; i++)
+		fwrite(empty, 1, BANK_ENTRY_SIZE, file);
+	if (!write_header(0))
+	{
+		close();
+		error = "can't write the file";
+		return false;
+	}
+	return true;
+}
+
+void Bank_Archive::close()
+{
+	// leave no more dead bytes than needed behind
+	if (file && writable && dead > 0 && dead * BANK_DEAD_SHARE > data_end)
+		rewrite(capacity);
+	unmap_file();
+	if (file)
+		fclose(file);
+	file = 0;
+	writable = false;
+	index.clear();
+	capacity = 0;
+	data_end = 0;
+	dead = 0;
+	device = 0;
+}
+
+const char* Bank_Archive::last_error() const
+{
+	return error;
+}
+
+bool Bank_Archive::is_open() const
+{
+	return file != 0;
+}
+
+const std::string& Bank_Archive::filename() const
+{
+	return path;
+}
+
+bool Bank_Archive::read_index()
+{
+	unsigned char header[BANK_HEADER_SIZE];
+	fseek(file, 0, SEEK_SET);
+	if (fread(header, 1, BANK_HEADER_SIZE, file) != BANK_HEADER_SIZE || memcmp(header, bank_magic, 8) != 0
+			|| get32(header + 8) < 1 || get32(header + 8) > bank_version)
+		return false;
+	capacity = get32(header + 12);
+	unsigned int count = get32(header + 16);
+	data_end = get32(header + 20);
+	// version 1 has no dead byte count and device identity (zeroed)
+	dead = get32(header + 24);
+	device = get32(header + 28);
+	if (count > capacity || data_end < BANK_HEADER_SIZE + capacity * BANK_ENTRY_SIZE)
+		return false;
+	index.resize(count);
+	unsigned char e[BANK_ENTRY_SIZE];
+	for (unsigned int i = 0; i < count; i++)
+	{
+		if (fread(e, 1, BANK_ENTRY_SIZE, file) != BANK_ENTRY_SIZE)
+			return false;
+		index[i].type = e[0];
+		index[i].rom = e[1];
+		index[i].slot = e[2] | (e[3] << 8);
+		memcpy(index[i].name, e + 4, BANK_NAME_SIZE);
+		index[i].name[BANK_NAME_SIZE - 1] = '\0';
+		index[i].offset = get32(e + 24);
+		index[i].length = get32(e + 28);
+		index[i].checksum = get32(e + 32);
+		if (index[i].offset + index[i].length > data_end)
+			return false;
+	}
+	return true;
+}
+
+bool Bank_Archive::write_header(unsigned int count)
+{
+	unsigned char header[BANK_HEADER_SIZE];
+	memset(header, 0, BANK_HEADER_SIZE);
+	memcpy(header, bank_magic, 8);
+	put32(header + 8, bank_version);
+	put32(header + 12, capacity);
+	put32(header + 16, count);
+	put32(header + 20, data_end);
+	put32(header + 24, dead);
+	put32(header + 28, device);
+	fseek(file, 0, SEEK_SET);
+	return fwrite(header, 1, BANK_HEADER_SIZE, file) == BANK_HEADER_SIZE;
+}
+
+bool Bank_Archive::write_entry(int i, const bank_entry& entry)
+{
+	unsigned char e[BANK_ENTRY_SIZE];
+	memset(e, 0, BANK_ENTRY_SIZE);
+	e[0] = entry.type;
+	e[1] = entry.rom;
+	e[2] = entry.slot & 0xff;
+	e[3] = (entry.slot >> 8) & 0xff;
+	memcpy(e + 4, entry.name, BANK_NAME_SIZE);
+	put32(e + 24, entry.offset);
+	put32(e + 28, entry.length);
+	put32(e + 32, entry.checksum);
+	fseek(file, BANK_HEADER_SIZE + i * BANK_ENTRY_SIZE, SEEK_SET);
+	return fwrite(e, 1, BANK_ENTRY_SIZE, file) == BANK_ENTRY_SIZE;
+}
+
+/**
+ * writes the live dumps to a new file with an index of \c new_capacity
+ * entries and replaces the archive with it
+ */
+bool Bank_Archive::rewrite(unsigned int new_capacity)
+{
+	pmesg("Bank_Archive::rewrite(%u) dead bytes: %u\n", new_capacity, dead);
+	if (!map_file())
+		return false;
+	std::string tmp = path + ".tmp";
+	FILE* f = fopen(tmp.c_str(), "w+b");
+	if (!f)
+		return false;
+	FILE* old_file = file;
+	unsigned int old_capacity = capacity, old_end = data_end, old_dead = dead;
+	std::vector<bank_entry> old_index = index;
+	// write through the members, on the new file
+	file = f;
+	capacity = new_capacity;
+	data_end = BANK_HEADER_SIZE + capacity * BANK_ENTRY_SIZE;
+	dead = 0;
+	bool ok = true;
+	unsigned char empty[BANK_ENTRY_SIZE];
+	memset(empty, 0, BANK_ENTRY_SIZE);
+	fseek(file, BANK_HEADER_SIZE, SEEK_SET);
+	for (unsigned int i = 0; i < capacity && ok; i++)
+		ok = fwrite(empty, 1, BANK_ENTRY_SIZE, file) == BANK_ENTRY_SIZE;
+	for (size_t i = 0; i < index.size() && ok; i++)
+	{
+		if (index[i].offset + index[i].length > map_size)
+		{
+			ok = false;
+			break;
+		}
+		fseek(file, data_end, SEEK_SET);
+		ok = fwrite(map + index[i].offset, 1, index[i].length, file) == index[i].length;
+		index[i].offset = data_end;
+		data_end += index[i].length;
+		ok = ok && write_entry(i, index[i]);
+	}
+	ok = ok && write_header(index.size()) && fflush(file) == 0;
+	unmap_file();
+	if (ok)
+	{
+		fclose(old_file);
+		fclose(file);
+		file = 0;
+#ifdef WIN32
+		// rename doesn't replace files on windows
+		remove(path.c_str());
+#endif
+		ok = rename(tmp.c_str(), path.c_str()) == 0;
+		file = fopen(ok ? path.c_str() : tmp.c_str(), "r+b");
+		if (file)
+			return true;
+		error = "can't reopen the archive";
+		return false;
+	}
+	// keep the old archive
+	fclose(file);
+	remove(tmp.c_str());
+	file = old_file;
+	capacity = old_capacity;
+	data_end = old_end;
+	dead = old_dead;
+	index.swap(old_index);
+	return false;
+}
+
+int Bank_Archive::entries() const
+{
+	return index.size();
+}
+
+const bank_entry* Bank_Archive::entry(int i) const
+{
+	if (i < 0 || i >= (int) index.size())
+		return 0;
+	return &index[i];
+}
+
+int Bank_Archive::find(int type, int rom, int slot) const
+{
+	for (size_t i = 0; i < index.size(); i++)
+		if (index[i].type == type && index[i].rom == rom && index[i].slot == slot)
+			return i;
+	return -1;
+}
+
+bool Bank_Archive::append(int type, int rom, int slot, const char* name, const unsigned char* data, unsigned int length)
+{
+	if (!file || !data)
+		return false;
+	int i = find(type, rom, slot);
+	if (i == -1 && index.size() >= capacity && !rewrite(2 * capacity))
+	{
+		error = "the index is full and can't be enlarged";
+		return false;
+	}
+	bank_entry e;
+	e.type = type;
+	e.rom = rom;
+	e.slot = slot;
+	memset(e.name, 0, BANK_NAME_SIZE);
+	snprintf(e.name, BANK_NAME_SIZE, "%s", name);
+	e.length = length;
+	e.checksum = bank_checksum(data, length);
+	// a replaced dump is overwritten if the new one fits
+	bool in_place = i != -1 && length <= index[i].length;
+	e.offset = in_place ? index[i].offset : data_end;
+	unsigned int new_end = in_place ? data_end : data_end + length;
+	unsigned int new_dead = dead + (i == -1 ? 0 : index[i].length - (in_place ? length : 0));
+	unmap_file();
+	fseek(file, e.offset, SEEK_SET);
+	if (fwrite(data, 1, length, file) != length)
+	{
+		error = "can't write the dump";
+		return false;
+	}
+	// commit the entry only when it is on disk
+	unsigned int old_end = data_end, old_dead = dead;
+	data_end = new_end;
+	dead = new_dead;
+	int n = i == -1 ? index.size() : i;
+	unsigned int count = i == -1 ? index.size() + 1 : index.size();
+	bool ret = write_entry(n, e) && write_header(count);
+	fflush(file);
+	if (!ret)
+	{
+		data_end = old_end;
+		dead = old_dead;
+		error = "can't write the index";
+		return false;
+	}
+	if (i == -1)
+		index.push_back(e);
+	else
+		index[i] = e;
+	return true;
+}
+
+bool Bank_Archive::map_file() const
+{
+	if (map)
+		return true;
+	if (!file)
+		return false;
+	fflush(file);
+#ifdef WIN32
+	HANDLE f = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING,
+			FILE_ATTRIBUTE_NORMAL, NULL);
+	if (f == INVALID_HANDLE_VALUE)
+		return false;
+	map_handle = CreateFileMappingA(f, NULL, PAGE_READONLY, 0, 0, NULL);
+	CloseHandle(f);
+	if (!map_handle)
+		return false;
+	map = (unsigned char*) MapViewOfFile(map_handle, FILE_MAP_READ, 0, 0, 0);
+	if (!map)
+	{
+		CloseHandle(map_handle);
+		map_handle = 0;
+		return false;
+	}
+	map_size = data_end;
+#else
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd == -1)
+		return false;
+	struct stat sbuf;
+	if (fstat(fd, &sbuf) != 0 || (size_t) sbuf.st_size < data_end)
+	{
+		::close(fd);
+		return false;
+	}
+	void* m = mmap(0, sbuf.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (m == MAP_FAILED)
+		return false;
+	map = (unsigned char*) m;
+	map_size = sbuf.st_size;
+#endif
+	return true;
+}
+
+void Bank_Archive::unmap_file() const
+{
+	if (!map)
+		return;
+#ifdef WIN32
+	UnmapViewOfFile(map);
+	CloseHandle(map_handle);
+	map_handle = 0;
+#else
+	munmap(map, map_size);
+#endif
+	map = 0;
+	map_size = 0;
+}
+
+const unsigned char* Bank_Archive::dump(int i) const
+{
+	if (i < 0 || i >= (int) index.size() || !map_file())
+		return 0;
+	const bank_entry& e = index[i];
+	if (e.offset + e.length > map_size || bank_checksum(map + e.offset, e.length) != e.checksum)
+	{
+		pmesg("Bank_Archive::dump(%d) checksum mismatch\n", i);
+		return 0;
+	}
+	return map + e.offset;
+}
+
+int Bank_Archive::export_files(const char* dir) const
+{
+	int written = 0;
+	char path[PATH_MAX];
+	for (size_t i = 0; i < index.size(); i++)
+	{
+		const unsigned char* data = dump(i);
+		if (!data)
+			continue;
+		// same names as Preset_Dump::save_file and Arp_Dump::save_file
+		std::string name_(index[i].name);
+		name_.erase(std::remove_if(name_.begin(), name_.end(), [](char c)
+		{	return !std::isalnum((unsigned char) c);}), name_.end());
+		snprintf(path, PATH_MAX, "%s/%02d-%04d-%s_%s.syx", dir, index[i].rom, index[i].slot, name_.c_str(),
+				index[i].type == ARP ? "ARP" : "PRES");
+		FILE* f = fopen(path, "wb");
+		if (!f)
+			continue;
+		if (fwrite(data, 1, index[i].length, f) == index[i].length)
+			++written;
+		fclose(f);
+	}
+	return written;
+}
@@ -134,6 +134,7 @@ Cfg::Cfg(int device_id)
 	defaults[CFG_INB] = 217;
 	defaults[CFG_KNOB_COLOR1] = 2;
 	defaults[CFG_KNOB_COLOR2] = 2;
+	defaults[CFG_DELTA_UPLOAD] = 0;
 
 	// load config
 	char _fname[PATH_MAX];
@@ -149,6 +150,19 @@ Cfg::Cfg(int device_id)
 			file.close();
 		}
 	}
+	// sysex delays by port ("setting port name")
+	snprintf(_fname, PATH_MAX, "%s/%d.delays", config_dir, sysex_id);
+	file.open(_fname);
+	if (file.is_open())
+	{
+		int delay;
+		std::string ports;
+		while (file >> delay && std::getline(file, ports))
+			if (ports.size() > 1)
+				port_delay[ports.substr(1)] = delay;
+		file.close();
+	}
+	file.clear();
 	snprintf(_fname, PATH_MAX, "%s/%d.cfg", config_dir, sysex_id); // load actual config
 	file.open(_fname);
 	unsigned char i;
@@ -231,6 +245,14 @@ Cfg::~Cfg()
 	file << check << std::endl;
 	file << export_dir << std::endl;
 	file.close();
+	// save sysex delays
+	snprintf(_file, PATH_MAX, "%s/%d.delays", config_dir, option[CFG_DEVICE_ID]);
+	file.open(_file, std::ios::trunc);
+	if (!file.is_open())
+		return;
+	for (std::map<std::string, int>::const_iterator it = port_delay.begin(); it != port_delay.end(); ++it)
+		file << it->second << " " << it->first << std::endl;
+	file.close();
 }
 
 void Cfg::set_cfg_option(int opt, int value)
@@ -270,6 +292,19 @@ int Cfg::getset_default(int opt)
 	return 0;
 }
 
+int Cfg::get_port_delay(const char* ports) const
+{
+	std::map<std::string, int>::const_iterator it = port_delay.find(ports);
+	if (it == port_delay.end())
+		return -1;
+	return it->second;
+}
+
+void Cfg::set_port_delay(const char* ports, int delay)
+{
+	port_delay[ports] = delay;
+}
+
 const char* Cfg::get_config_dir() const
 {
 	//pmesg("Cfg::get_config_dir()  \n");
@@ -331,6 +366,7 @@ void Cfg::apply(bool colors_only)
 			(unsigned char) option[CFG_INB]);
 	ui->set_knobcolor(0, (char) option[CFG_KNOB_COLOR1]);
 	ui->set_knobcolor(1, (char) option[CFG_KNOB_COLOR2]);
+	Fl_Knob::clear_sprites();
 	if (colors_only)
 		return;
 	ui->syncview = option[CFG_SYNCVIEW];
@@ -352,6 +388,7 @@ void Cfg::apply(bool colors_only)
 	((Fl_Button*) ui->g_knobmode->child(option[CFG_KNOBMODE]))->setonly();
 	option[CFG_CLOSED_LOOP_UPLOAD] ? ui->closed_loop_upload->set() : ui->closed_loop_upload->clear();
 	option[CFG_CLOSED_LOOP_DOWNLOAD] ? ui->closed_loop_download->set() : ui->closed_loop_download->clear();
+	option[CFG_DELTA_UPLOAD] ? ui->delta_upload->set() : ui->delta_upload->clear();
 	ui->export_dir->value(get_export_dir());
 	// UI misc
 	if (option[CFG_TOOLTIPS])
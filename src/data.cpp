@@ -18,12 +18,15 @@
 
 #include <string.h>
 #include <algorithm>
+#include <map>
 #include <fstream>
 #include <cctype>
 #include <sys/stat.h>
 #include <FL/fl_ask.H>
 
 #include "data.h"
+#include "bank.h"
+#include "names.h"
 #include "midi.h"
 #include "cfg.h"
 #include "pxk.h"
@@ -36,6 +39,9 @@ extern PXK* pxk;
 extern PD_UI* ui;
 extern PD_Arp_Step* arp_step[32];
 
+/// maximum number of changed parameters to save using edit messages
+#define DELTA_UPLOAD_MAX 200
+
 /**
  * calculates integer value of two nibbelized MIDI bytes
  * @param lsb least significant byte of value
@@ -51,6 +57,124 @@ static int inline unibble(const unsigned char* lsb, const unsigned char* msb)
 	return raw_value;
 }
 
+// ###############
+// displayed values
+// #################
+/// highest parameter ID show() displays
+#define SHOWN_MAX_ID 1992
+/// values the preset widgets show, by parameter ID and layer
+static int shown_value[SHOWN_MAX_ID + 1][4];
+/// false until show() did a complete refresh
+static bool shown_valid = false;
+/// widgets the last show() updated
+static int shown_updates = 0;
+/// a2k flag of the shown preset (a2k hides the riff ROM)
+static int shown_a2k = -1;
+
+/**
+ * refreshes a preset widget if its value differs from what it shows.
+ * values without a widget (drawn by the piano or the envelope editors)
+ * are only remembered
+ * @returns true if the value changed
+ */
+static bool show_value(int id, int layer, int value, bool force)
+{
+	if (!force && shown_value[id][layer] == value)
+		return false;
+	shown_value[id][layer] = value;
+	if (pwid[id][layer])
+	{
+		pwid[id][layer]->set_value(value);
+		++shown_updates;
+	}
+	return true;
+}
+
+/// true for the IDs update_piano() and update_envelopes() display
+static bool shown_by_editors(int id)
+{
+	return id == 1039 || id == 1040 || id == 1286 || id == 1287 || id == 1295 || id == 1296
+			|| (id >= 1413 && id <= 1424) || id == 1429 || (id >= 1793 && id <= 1834);
+}
+
+// ###############
+// dump pool
+// #################
+/// number of free buffers we keep per size
+#define DUMP_POOL_KEEP 16
+/// free buffers, by size
+static std::map<int, std::vector<unsigned char*> > dump_pool;
+
+unsigned char* dump_buffer_alloc(int size)
+{
+	std::vector<unsigned char*>& free_list = dump_pool[size];
+	if (free_list.empty())
+		return new unsigned char[size];
+	unsigned char* buffer = free_list.back();
+	free_list.pop_back();
+	return buffer;
+}
+
+void dump_buffer_free(unsigned char* buffer, int size)
+{
+	if (!buffer)
+		return;
+	std::vector<unsigned char*>& free_list = dump_pool[size];
+	if (free_list.size() < DUMP_POOL_KEEP)
+		free_list.push_back(buffer);
+	else
+		delete[] buffer;
+}
+
+unsigned int preset_dump_checksum(const unsigned char* dump, int size)
+{
+	unsigned int h = 2166136261u;
+	int start = 0; // start of the current packet
+	for (int i = 0; i < size; i++)
+	{
+		unsigned char c = dump[i];
+		int pos = i - start;
+		if (pos == 3 || pos == 6 || (start == 0 && (pos == 7 || pos == 8 || pos == 33 || pos == 34)))
+			c = 0;
+		// FNV-1a
+		h ^= c;
+		h *= 16777619u;
+		if (dump[i] == 0xf7)
+			start = i + 1;
+	}
+	return h;
+}
+
+void* Preset_Dump::operator new(size_t size)
+{
+	return dump_buffer_alloc(size);
+}
+
+void Preset_Dump::operator delete(void* p, size_t size)
+{
+	dump_buffer_free((unsigned char*) p, size);
+}
+
+void* Arp_Dump::operator new(size_t size)
+{
+	return dump_buffer_alloc(size);
+}
+
+void Arp_Dump::operator delete(void* p, size_t size)
+{
+	dump_buffer_free((unsigned char*) p, size);
+}
+
+void* Setup_Dump::operator new(size_t size)
+{
+	return dump_buffer_alloc(size);
+}
+
+void Setup_Dump::operator delete(void* p, size_t size)
+{
+	dump_buffer_free((unsigned char*) p, size);
+}
+
 // ###############
 // Preset_Dump class
 // #################
@@ -60,6 +184,12 @@ Preset_Dump::Preset_Dump(int dump_size, const unsigned char* dump_data, int p_si
 	disable_add_undo = false;
 	data_is_changed = false;
 	data = 0;
+	undo_ring = 0;
+	undo_first = 0;
+	undo_count = 0;
+	undo_pos = 0;
+	undo_depth = 0;
+	undo_continue = false;
 	size = dump_size;
 	packet_size = p_size;
 	(size > 1607) ? extra_controller = 4 : extra_controller = 0;
@@ -82,16 +212,20 @@ Preset_Dump::Preset_Dump(int dump_size, const unsigned char* dump_data, int p_si
 	const int ext_ctrl_off = 166;
 	const int ext_ctrl_bytes = 8;
 
-	std::vector<unsigned char> v(dump_data, dump_data + size);
+	// only converted dumps need a temporary copy
+	std::vector<unsigned char> v;
 	std::vector<unsigned char>::iterator it;
 
 	if (dump_data)
 	{
+		if ((pxk->machine_id == 0 && size != 1615) || (pxk->machine_id == 1 && size != 1607)
+				|| (pxk->machine_id == 2 && size != 1605))
+			v.assign(dump_data, dump_data + size);
 		if (pxk->machine_id == 0 && size != 1615)
 		{
 			// converting to CS sysex...
 			int adj_size = 1615;  // override size for command station
-			data = new unsigned char[adj_size];
+			data = dump_buffer_alloc(adj_size);
 
 			v[9] = 0x5E;   // increase num bytes (from 0x56 or 0x54)  p2k/a2k
 			v[13] = 0x38;  // increase # of controllers from (0x34)   p2k
@@ -128,7 +262,7 @@ Preset_Dump::Preset_Dump(int dump_size, const unsigned char* dump_data, int p_si
 		{
 			// converting to P2K sysex...
 			int adj_size = 1607;  // override size for p2k
-			data = new unsigned char[adj_size];
+			data = dump_buffer_alloc(adj_size);
 
 			v[9] = 0x56;   // decrease/increase num bytes (from 0x5E or 0x54)  CS/a2k
 			v[13] = 0x34;  // decrease # of controllers from (0x38)   CS
@@ -175,7 +309,7 @@ Preset_Dump::Preset_Dump(int dump_size, const unsigned char* dump_data, int p_si
 		{
 			// converting to A2K sysex...
 			int adj_size = 1605;  // override size for a2k
-			data = new unsigned char[adj_size];
+			data = dump_buffer_alloc(adj_size);
 
 			v[9] = 0x54;   // decrease num bytes (from 0x5E or 0x56)  CS/p2k
 			v[13] = 0x34;  // decrease # of controllers from (0x38)   CS
@@ -234,13 +368,13 @@ Preset_Dump::Preset_Dump(int dump_size, const unsigned char* dump_data, int p_si
 		}
 		else // nominal case, sysex load is native to instrument
 		{
-			data = new unsigned char[size];
+			data = dump_buffer_alloc(size);
+			memcpy(data, dump_data, size);
 		}
-		
-		std::copy(v.begin(), v.end(), data);
-		snprintf((char*)name, 17, "%s", data + DUMP_HEADER_SIZE + 9);
 
-		v.clear();
+		if (!v.empty())
+			std::copy(v.begin(), v.end(), data);
+		snprintf((char*)name, 17, "%s", data + DUMP_HEADER_SIZE + 9);
 	}
 
 	// silently update outside name changes
@@ -271,11 +405,9 @@ Preset_Dump::Preset_Dump(int dump_size, const unsigned char* dump_data, int p_si
 
 Preset_Dump::~Preset_Dump()
 {
-
-	//undo_s.clear();
-	//redo_s.clear();
 	//pmesg("Preset_Dump::~Preset_Dump()\n");
-	if (data) delete[] data;
+	dump_buffer_free(data, size);
+	if (undo_ring) delete[] undo_ring;
 }
 
 void Preset_Dump::repack_sysex(std::vector<unsigned char> &v, int shift, int dest_size)
@@ -312,8 +444,10 @@ void Preset_Dump::set_changed(bool set)
 	else
 	{
 		data_is_changed = false;
-		undo_s.clear();
-		redo_s.clear();
+		undo_first = 0;
+		undo_count = 0;
+		undo_pos = 0;
+		undo_continue = false;
 	}
 }
 
@@ -338,6 +472,11 @@ const char* Preset_Dump::get_name() const
 	return (const char*) n;
 }
 
+const unsigned char* Preset_Dump::get_name_bytes() const
+{
+	return data + DUMP_HEADER_SIZE + 9;
+}
+
 int Preset_Dump::get_number() const
 {
 	return number;
@@ -372,24 +511,17 @@ int Preset_Dump::set_value(int id, int value, int layer)
 	if (unibble((const unsigned char*) data + offset, (const unsigned char*) data + offset + 1) == value)
 		return 0;
 	// save undo
-	if (!disable_add_undo && id > 914 && !(ui->eall && layer > 0))
-	{
-		// but not all steps and not if we are undoing
-		if (!undo_s.empty())
-		{
-			parameter current = undo_s.front();
-			if (current.id != id || current.layer != layer)
-				add_undo(id, layer);
-		}
-		else
-			add_undo(id, layer);
-	}
+	if (!disable_add_undo && id > 914)
+		add_undo(id, layer);
 	// for names, only one byte is used per character...
 	data[offset] = value % 128;
 	if (id > 914) // ...otherwise 2
 		data[offset + 1] = value / 128;
 	if (!data_is_changed)
 		data_is_changed = true;
+	// edits of the displayed preset go to the widgets
+	if (this == pxk->preset && id <= SHOWN_MAX_ID)
+		shown_value[id][layer] = get_value(id, layer);
 	return 1;
 }
 
@@ -444,8 +576,7 @@ void Preset_Dump::set_name(const char* val, int type, int position)
 			ui->n_name_m->position(position);
 		}
 	}
-	snprintf(buf, 30, "%02d.%03d.%d %s", rom_id, number % 128, number / 128, name);
-	ui->main->preset_name->copy_label((char*) buf);
+	pxk->update_change_count();
 	// update the name on the device, just for fun
 	for (i = offset; i < len + offset; i++)
 		midi->edit_parameter_value(899 + i, *(name + i));
@@ -455,8 +586,7 @@ void Preset_Dump::show() const
 {
 	//pmesg("Preset_Dump::show()\n");
 	char buf[30];
-	snprintf(buf, 30, "%02d.%03d.%d %s", rom_id, number % 128, number / 128, name);
-	ui->main->preset_name->copy_label((char*) buf);
+	show_name();
 	snprintf(buf, 30, "%02d.%03d.%d", rom_id, number % 128, number / 128);
 	ui->n_cat_m->copy_label(buf);
 	snprintf(buf, 17, "%s", name);
@@ -467,52 +597,102 @@ void Preset_Dump::show() const
 	while (strlen(buf) > 3 || buf[strlen(buf) - 1] == ' ')
 		buf[strlen(buf) - 1] = '\0';
 	ui->n_cat_m->value((const char*) buf);
+	// only touch widgets whose value changed since the last show()
+	bool force = !shown_valid || shown_a2k != a2k;
+	shown_a2k = a2k;
+	shown_updates = 0;
 	// load the names into the browsers first,
 	// so they are available for selection
 	// instruments
-	pwid[1439][0]->set_value(get_value(1439, 0));
-	pwid[1439][1]->set_value(get_value(1439, 1));
-	pwid[1439][2]->set_value(get_value(1439, 2));
-	pwid[1439][3]->set_value(get_value(1439, 3));
+	bool instrument_rom[4];
+	for (int l = 0; l < 4; l++)
+		instrument_rom[l] = show_value(1439, l, get_value(1439, l), force);
 	// riffs
-	if (a2k == 0)
-		pwid[929][0]->set_value(get_value(929));
+	bool riff_rom = a2k == 0 && show_value(929, 0, get_value(929), force);
 	// arp
-	pwid[1042][0]->set_value(get_value(1042));
+	bool arp_rom = show_value(1042, 0, get_value(1042), force);
 	// link 1
-	pwid[1299][0]->set_value(get_value(1299));
+	bool link1_rom = show_value(1299, 0, get_value(1299), force);
 	// link 2
-	pwid[1300][0]->set_value(get_value(1300));
-	for (int i = 915; i <= 1300; i++) // preset params
+	bool link2_rom = show_value(1300, 0, get_value(1300), force);
+	bool piano = force;
+	bool envelopes = force;
+	// arp/link ranges, key/vel/rt ranges, transpose and envelopes (mostly without widgets)
+	static const int preset_ranges[] =
+	{ 1039, 1040, 1286, 1287, 1295, 1296 };
+	for (int r = 0; r < 6; r++)
+		if (show_value(preset_ranges[r], 0, get_value(preset_ranges[r]), force))
+			piano = true;
+	for (int l = 0; l < 4; l++)
 	{
-		if (!pwid[i][0] || (i > 1152 && i < 1169) || i == 929) // skip fx & riff rom
+		for (int i = 1413; i <= 1429; i++)
+			if ((i <= 1424 || i == 1429) && show_value(i, l, get_value(i, l), force))
+				piano = true;
+		for (int i = 1793; i <= 1834; i++)
+			if (show_value(i, l, get_value(i, l), force))
+				envelopes = true;
+	}
+	const std::vector<pwid_entry>& preset_params = pwid_registry.group(PWID_PRESET);
+	for (size_t p = 0; p < preset_params.size(); p++)
+	{
+		int i = preset_params[p].id;
+		if (i == 929 || shown_by_editors(i)) // skip riff rom and ranges
 			continue;
-		pwid[i][0]->set_value(get_value(i));
+		// a new name list lost the selection
+		bool reload = (i == 928 && riff_rom) || (i == 1027 && arp_rom) || (i == 1281 && link1_rom)
+				|| (i == 1290 && link2_rom);
+		show_value(i, 0, get_value(i), force || reload);
 	}
-	for (int i = 1409; i <= 1992; i++) // layer params
+	const std::vector<pwid_entry>& layer_params = pwid_registry.group(PWID_LAYER);
+	for (size_t p = 0; p < layer_params.size(); p++)
 	{
-		if (!pwid[i][0] || i == 1439) // skip instrument rom
+		int i = layer_params[p].id;
+		int l = layer_params[p].layer;
+		if (i == 1439 || shown_by_editors(i)) // skip instrument rom, ranges and envelopes
 			continue;
-		pwid[i][0]->set_value(get_value(i, 0));
-		pwid[i][1]->set_value(get_value(i, 1));
-		pwid[i][2]->set_value(get_value(i, 2));
-		pwid[i][3]->set_value(get_value(i, 3));
+		show_value(i, l, get_value(i, l), force || (i == 1409 && instrument_rom[l]));
 	}
-	update_piano();
-	update_envelopes();
+	shown_valid = true;
+	if (piano)
+		update_piano();
+	if (envelopes)
+		update_envelopes();
+	pmesg("Preset_Dump::show() %d widgets updated\n", shown_updates);
 	if (pxk->midi_mode != MULTI || pxk->selected_fx_channel != -1)
 		show_fx();
 	// done, enable user control
-	pxk->display_status("Edit buffer synchronized.");
+	char status[48];
+	snprintf(status, 48, "Edit buffer synchronized (%d widgets).", shown_updates);
+	pxk->display_status(status);
 	ui->supergroup->clear_output();
 }
 
+int Preset_Dump::widgets_updated()
+{
+	return shown_updates;
+}
+
+void Preset_Dump::invalidate_shown()
+{
+	shown_valid = false;
+}
+
+void Preset_Dump::show_name(int changes) const
+{
+	char buf[40];
+	if (changes > 0)
+		snprintf(buf, 40, "%02d.%03d.%d %s (%d)", rom_id, number % 128, number / 128, name, changes);
+	else
+		snprintf(buf, 40, "%02d.%03d.%d %s", rom_id, number % 128, number / 128, name);
+	ui->main->preset_name->copy_label((char*) buf);
+}
+
 void Preset_Dump::show_fx() const
 {
 	//pmesg("Preset_Dump::show_fx()\n");
-	for (int i = 1153; i < 1169; i++)
-		if (pwid[i][0])
-			pwid[i][0]->set_value(get_value(i));
+	const std::vector<pwid_entry>& fx = pwid_registry.group(PWID_FX_PRESET);
+	for (size_t i = 0; i < fx.size(); i++)
+		fx[i].widget->set_value(get_value(fx[i].id));
 }
 
 void Preset_Dump::update_piano() const
@@ -673,7 +853,42 @@ void Preset_Dump::upload(int packet, int closed, bool show)
 	}
 }
 
-void Preset_Dump::save_file(const char* save_dir, int offset)
+bool Preset_Dump::upload_changes(const Preset_Dump* original) const
+{
+	std::vector<parameter_change> changes;
+	int count = diff(original, &changes);
+	pmesg("Preset_Dump::upload_changes() %d changes\n", count);
+	// ~4 bytes per parameter, a complete dump is ~1600 bytes plus ACKs
+	if (count < 0 || count > DELTA_UPLOAD_MAX)
+		return false;
+	int ids[DELTA_UPLOAD_MAX];
+	int values[DELTA_UPLOAD_MAX];
+	// common parameters first, then every layer
+	for (int layer = -1; layer < 4; layer++)
+	{
+		int n = 0;
+		// reverse order so roms are set before instruments/riffs/arps
+		for (int i = count - 1; i >= 0; i--)
+		{
+			if ((layer == -1 && changes[i].id >= 1409) || (layer != -1 && (changes[i].id < 1409 || changes[i].layer != layer)))
+				continue;
+			ids[n] = changes[i].id;
+			values[n] = changes[i].new_value;
+			++n;
+		}
+		if (n == 0)
+			continue;
+		if (layer != -1)
+			midi->edit_parameter_value(898, layer);
+		midi->edit_parameter_values(ids, values, n);
+	}
+	// restore layer selection
+	if (pxk->selected_layer >= 0)
+		midi->edit_parameter_value(898, pxk->selected_layer);
+	return true;
+}
+
+void Preset_Dump::save_file(const char* save_dir, int offset, std::string* saved)
 {
 	pmesg("Preset_Dump::save_file() \n");
 	char path[PATH_MAX];
@@ -707,9 +922,29 @@ void Preset_Dump::save_file(const char* save_dir, int offset)
 	update_checksum(); // save a valid dump
 	file.write((const char*) data, size);
 	file.close();
+	if (saved)
+		*saved = path;
 	pxk->display_status("Program file saved.");
 }
 
+bool Preset_Dump::save_archive(Bank_Archive* bank, int offset)
+{
+	pmesg("Preset_Dump::save_archive(offset: %d) \n", offset);
+	update_checksum(); // save a valid dump
+	if (!bank->append(PRESET, pxk->selected_preset_rom, offset, get_name(), data, size))
+	{
+		pxk->display_status("*** Could not write the bank archive.");
+		return false;
+	}
+	pxk->display_status("Program saved to bank archive.");
+	return true;
+}
+
+unsigned int Preset_Dump::normalized_checksum() const
+{
+	return preset_dump_checksum(data, size);
+}
+
 void Preset_Dump::move(int number)
 {
 	pmesg("Preset_Dump::move(position: %d)\n", number);
@@ -890,155 +1125,213 @@ void Preset_Dump::copy(int type, int src, int dst)
 				ui->copy_browser->load_n(PRESET, 0, dst);
 			// upload preset
 			move(dst);
-			upload(0, cfg->get_cfg_option(CFG_CLOSED_LOOP_UPLOAD));
+			if (cfg->get_cfg_option(CFG_DELTA_UPLOAD) && pxk->preset_copy && upload_changes(pxk->preset_copy))
+			{
+				// edit buffer is up to date, copy it to the target location
+				midi->copy(C_PRESET, -1, dst);
+				pxk->display_status("Program saved.");
+			}
+			else
+				upload(0, cfg->get_cfg_option(CFG_CLOSED_LOOP_UPLOAD));
 			set_changed(false);
 			delete pxk->preset_copy;
 			pxk->preset_copy = clone();
 		}
 	}
+	if (type >= C_LAYER && type <= C_LAYER_PATCHCORD)
+		pxk->update_change_count();
+}
+
+Preset_Dump::parameter& Preset_Dump::undo_record(int pos) const
+{
+	return undo_ring[(undo_first + pos) % UNDO_SIZE];
+}
+
+bool Preset_Dump::undo_group_contains(int id, int layer) const
+{
+	// nothing to merge with after an undo
+	if (!undo_ring || undo_pos == 0 || undo_pos != undo_count)
+		return false;
+	for (int i = undo_pos - 1; i >= 0; i--)
+	{
+		const parameter& r = undo_record(i);
+		if (r.id == id && r.layer == layer)
+			return true;
+		if (r.group)
+			break;
+	}
+	return false;
+}
+
+void Preset_Dump::push_undo(int id, int layer, bool group)
+{
+	if (!undo_ring)
+		undo_ring = new parameter[UNDO_SIZE];
+	// a new edit discards everything that could be redone
+	undo_count = undo_pos;
+	// ring is full, drop the oldest group
+	if (undo_count == UNDO_SIZE)
+	{
+		do
+		{
+			undo_first = (undo_first + 1) % UNDO_SIZE;
+			--undo_count;
+		} while (undo_count && !undo_record(0).group);
+	}
+	if (undo_count == 0)
+		group = true;
+	parameter& r = undo_record(undo_count);
+	r.id = id;
+	r.layer = layer;
+	r.value = get_value(id, layer);
+	r.group = group;
+	undo_pos = ++undo_count;
 }
 
 void Preset_Dump::add_undo(int id, int layer)
 {
 	if (disable_add_undo)
 		return;
-	//pmesg("Preset_Dump::add_undo(%d, %d, %d)\n", id, value, layer);
-	parameter changed, prev_changed;
+	//pmesg("Preset_Dump::add_undo(%d, %d)\n", id, layer);
+	// common parameters don't care about the layer
+	if (id < 1409)
+		layer = 0;
 	// envelopes are special because we change 2 values at once
 	// and on undo we want to change both back at once
-	// everything else just doesn't feel right
+	int second_id = 0;
 	if ((id > 1793 && id < 1833) && id != 1806 && id != 1819) // envelopes
 	{
-		int second_id = 0;
 		if (id <= 1805 || id >= 1820)
 		{
 			if (id % 2 != 0)
 				id -= 1;
-			second_id = id + 1;
 		}
 		else
 		{
 			if (id % 2 == 0)
 				id -= 1;
-			second_id = id + 1;
-		}
-		// ^^ id is rate, second_id is lvl
-		if (!undo_s.empty())
-		{
-			prev_changed = undo_s.front();
-			if (prev_changed.id == second_id && prev_changed.layer == layer)
-				return; // dont save all steps
 		}
-		// save current values
-		changed.layer = layer;
-		// first value
-		changed.id = id;
-		changed.value = get_value(id, layer);
-		undo_s.push_front(changed);
-		// second value
-		changed.id = second_id;
-		changed.value = get_value(second_id, layer);
-		undo_s.push_front(changed);
+		// id is rate, second_id is lvl
+		second_id = id + 1;
 	}
-	else
+	// dont save all steps of a drag
+	if (undo_group_contains(id, layer))
 	{
-		// save current value
-		changed.layer = layer;
-		changed.id = id;
-		changed.value = get_value(id, layer);
-		undo_s.push_front(changed);
+		undo_continue = undo_depth > 0;
+		return;
 	}
-	redo_s.clear();
+	push_undo(id, layer, !undo_continue);
+	if (second_id)
+		push_undo(second_id, layer, false);
+	undo_continue = undo_depth > 0;
 	ui->redo_b->deactivate();
 	ui->undo_b->activate();
 }
 
-void Preset_Dump::undo()
+void Preset_Dump::begin_undo_group()
+{
+	if (undo_depth++ == 0)
+		undo_continue = false;
+}
+
+void Preset_Dump::end_undo_group()
 {
-	if (!undo_s.empty())
-	{
-		//pmesg("Preset_Dump::undo()\n");
-		// 10000 undos max! ")
-		if (undo_s.size() > 10000)
-			undo_s.pop_back();
-		bool repeat = true;
-		Undo:
-		// save current value to redo
-		parameter p = undo_s.front();
-		parameter c;
-		c.layer = p.layer;
-		c.id = p.id;
-		c.value = get_value(p.id, p.layer);
-		// undo
-		pxk->widget_callback(p.id, p.value, p.layer);
-		// update stack
-		undo_s.pop_front();
-		redo_s.push_front(c);
-		if (undo_s.empty())
-			ui->undo_b->deactivate();
-		else if (repeat && (p.id > 1793 && p.id < 1833) && p.id != 1806 && p.id != 1819) // envelopes
+	if (undo_depth > 0 && --undo_depth == 0)
+		undo_continue = false;
+}
+
+void Preset_Dump::swap_undo_group(int from, int to)
+{
+	//pmesg("Preset_Dump::swap_undo_group(%d, %d)\n", from, to);
+	disable_add_undo = true;
+	for (int i = from; i < to; i++)
+	{
+		parameter& r = undo_record(i);
+		int current = get_value(r.id, r.layer);
+		set_value(r.id, r.value, r.layer);
+		// volume of a muted layer goes out when it gets unmuted
+		if (r.id != 1410 || !pxk->hold_muted_volume(r.layer, r.value))
+			midi->queue_parameter_value(r.id, r.value, (r.id < 1409) ? -2 : r.layer);
+		r.value = current;
+	}
+	// the whole group goes out in one message
+	midi->flush_parameter_values();
+	// update UI
+	bool envelopes = false;
+	bool piano = false;
+	for (int i = from; i < to; i++)
+	{
+		const parameter& r = undo_record(i);
+		if (r.id > 1792 && r.id < 1835)
+			envelopes = true;
+		else if ((r.id > 1412 && r.id < 1425) || r.id == 1429)
+			piano = true;
+		else
 		{
-			repeat = false;
-			goto Undo;
+			int value = get_value(r.id, r.layer);
+			update_ui_from_xdo(r.id, value, r.layer);
+			pxk->update_dependencies(r.id, value, r.layer);
 		}
-		// update UI
-		ui->redo_b->activate();
-		update_ui_from_xdo(p.id, p.value, p.layer);
 	}
-	else
+	// dependencies (fx defaults) mirror the device and must not become undo steps
+	disable_add_undo = false;
+	if (envelopes)
+		update_envelopes();
+	if (piano)
+		update_piano();
+	pxk->update_change_count();
+}
+
+void Preset_Dump::undo()
+{
+	if (!undo_ring || undo_pos == 0)
+	{
 		pxk->display_status("*** Nothing to Undo.");
+		return;
+	}
+	//pmesg("Preset_Dump::undo()\n");
+	int start = undo_pos - 1;
+	while (start > 0 && !undo_record(start).group)
+		--start;
+	swap_undo_group(start, undo_pos);
+	undo_pos = start;
+	if (undo_pos == 0)
+		ui->undo_b->deactivate();
+	ui->redo_b->activate();
 }
 
 void Preset_Dump::redo()
 {
-	if (!redo_s.empty())
-	{
-		//pmesg("Preset_Dump::redo()\n");
-		bool repeat = true;
-		Redo:
-		// save current value for undo
-		parameter p = redo_s.front();
-		parameter c;
-		c.layer = p.layer;
-		c.id = p.id;
-		c.value = get_value(p.id, p.layer);
-		undo_s.push_front(c);
-		// redo
-		pxk->widget_callback(p.id, p.value, p.layer);
-		// update stack
-		redo_s.pop_front();
-		if (redo_s.empty())
-			ui->redo_b->deactivate();
-		else if (repeat && (p.id > 1793 && p.id < 1833) && p.id != 1806 && p.id != 1819) // envelopes
-		{
-			repeat = false;
-			goto Redo;
-		}
-		// update UI
-		ui->undo_b->activate();
-		update_ui_from_xdo(p.id, p.value, p.layer);
-	}
-	else
+	if (!undo_ring || undo_pos == undo_count)
+	{
 		pxk->display_status("*** Nothing to redo.");
+		return;
+	}
+	//pmesg("Preset_Dump::redo()\n");
+	int end = undo_pos + 1;
+	while (end < undo_count && !undo_record(end).group)
+		++end;
+	swap_undo_group(undo_pos, end);
+	undo_pos = end;
+	if (undo_pos == undo_count)
+		ui->redo_b->deactivate();
+	ui->undo_b->activate();
 }
 
 void Preset_Dump::update_ui_from_xdo(int id, int value, int layer) const
 {
-	if (id > 1792 && id < 1835)
-		update_envelopes();
-	else if ((id > 1412 && id < 1425) || id == 1429)
-		update_piano();
-	else
-	{
-		pwid_editing = pwid[id][layer];
-		int* minimax = pwid_editing->get_minimax();
-		ui->value_input->minimum((double) minimax[0]);
-		ui->value_input->maximum((double) minimax[1]);
-		pwid[1][0]->set_value(value);
-		pwid[id][layer]->set_value(value);
-		ui->forma_out->set_value(id, layer, value);
-		ui->forma_out->redraw();
-	}
+	if (!pwid[id][layer])
+		return;
+	pwid_editing = pwid[id][layer];
+	int* minimax = pwid_editing->get_minimax();
+	ui->value_input->minimum((double) minimax[0]);
+	ui->value_input->maximum((double) minimax[1]);
+	pwid[1][0]->set_value(value);
+	pwid[id][layer]->set_value(value);
+	if (id <= SHOWN_MAX_ID)
+		shown_value[id][layer] = value;
+	ui->forma_out->set_value(id, layer, value);
+	ui->forma_out->redraw();
 }
 
 // maps Parameter IDs from the device to data position in preset dump
@@ -1099,6 +1392,90 @@ void Preset_Dump::idmap(const int& id, const int& layer, int& id_mapped) const
 	}
 }
 
+bool Preset_Dump::packet_equals(const Preset_Dump* other, int packet) const
+{
+	int start = 0;
+	int length = DUMP_HEADER_SIZE;
+	if (packet > 0)
+	{
+		start = DUMP_HEADER_SIZE + (packet - 1) * packet_size;
+		length = packet_size;
+		if (start + length > size)
+			length = size - start;
+	}
+	// skip F0 18 0F dd 55 10 0x pp pp and the trailing checksum + F7
+	if (length <= 11)
+		return true;
+	return memcmp(data + start + 9, other->data + start + 9, length - 11) == 0;
+}
+
+int Preset_Dump::diff(const Preset_Dump* original, std::vector<parameter_change>* changes) const
+{
+	if (!data || !original || !original->data || size != original->size || packet_size != original->packet_size)
+		return -1;
+	// parameter ID ranges as mapped by idmap(), layer parameters start at 1409
+	static const int ranges[9][2] =
+	{
+	{ 899, 970 },
+	{ 1025, 1043 },
+	{ 1153, 1168 },
+	{ 1281, 1300 },
+	{ 1409, 1439 },
+	{ 1537, 1539 },
+	{ 1665, 1674 },
+	{ 1793, 1834 },
+	{ 1921, 1992 } };
+	// compare packets first, most edits only touch one or two of them
+	bool equal[16];
+	int packets = (size - DUMP_HEADER_SIZE) / packet_size + 2;
+	if (packets > 16)
+		return -1;
+	bool all_equal = true;
+	for (int i = 0; i < packets; i++)
+	{
+		equal[i] = packet_equals(original, i);
+		if (i > 0 && !equal[i])
+			all_equal = false;
+	}
+	if (all_equal)
+		return 0;
+	int count = 0;
+	int offset;
+	parameter_change c;
+	for (int r = 0; r < 9; r++)
+	{
+		int layers = (ranges[r][0] < 1409) ? 1 : 4;
+		for (int layer = 0; layer < layers; layer++)
+			for (int id = ranges[r][0]; id <= ranges[r][1]; id++)
+			{
+				offset = 0;
+				idmap(id, layer, offset);
+				if (offset == 0 || equal[(offset - DUMP_HEADER_SIZE) / packet_size + 1])
+					continue;
+				if (id < 915) // name chars are stored in one byte
+				{
+					c.new_value = data[offset];
+					c.old_value = original->data[offset];
+				}
+				else
+				{
+					c.new_value = unibble(data + offset, data + offset + 1);
+					c.old_value = unibble(original->data + offset, original->data + offset + 1);
+				}
+				if (c.new_value == c.old_value)
+					continue;
+				++count;
+				if (changes)
+				{
+					c.id = id;
+					c.layer = layer;
+					changes->push_back(c);
+				}
+			}
+	}
+	return count;
+}
+
 // updates checksums in the dump
 void Preset_Dump::update_checksum()
 {
@@ -1134,7 +1511,7 @@ Arp_Dump::Arp_Dump(int dump_size, const unsigned char* dump_data, bool show_edit
 {
 	pmesg("Arp_Dump::Arp_Dump(size: %d, data)\n", dump_size);
 	size = dump_size;
-	data = new unsigned char[dump_size];
+	data = dump_buffer_alloc(dump_size);
 	memcpy(data, dump_data, dump_size);
 
 	snprintf((char*)name, 17, "%s                 ", data + 14);
@@ -1149,7 +1526,7 @@ Arp_Dump::Arp_Dump(int dump_size, const unsigned char* dump_data, bool show_edit
 Arp_Dump::~Arp_Dump()
 {
 	pmesg("Arp_Dump::~Arp_Dump()\n");
-	delete[] data;
+	dump_buffer_free(data, size);
 }
 
 int Arp_Dump::get_number() const
@@ -1288,7 +1665,7 @@ void Arp_Dump::load_file(int num) const
 	pxk->display_status("Arp pattern loaded.");
 }
 
-void Arp_Dump::save_file(const char* save_dir, int offset) const
+void Arp_Dump::save_file(const char* save_dir, int offset, std::string* saved) const
 {
 	pmesg("Arp_Dump::save_file() \n");
 	char path[PATH_MAX];
@@ -1309,9 +1686,23 @@ void Arp_Dump::save_file(const char* save_dir, int offset) const
 
 	file.write((const char*)data, size);
 	file.close();
+	if (saved)
+		*saved = path;
 	pxk->display_status("Arp pattern saved.");
 }
 
+bool Arp_Dump::save_archive(Bank_Archive* bank, int offset) const
+{
+	pmesg("Arp_Dump::save_archive(offset: %d) \n", offset);
+	if (!bank->append(ARP, pxk->selected_preset_rom, offset, (const char*) name, data, size))
+	{
+		pxk->display_status("*** Could not write the bank archive.");
+		return false;
+	}
+	pxk->display_status("Arp pattern saved to bank archive.");
+	return true;
+}
+
 
 // #################
 // Setup_Dump class
@@ -1324,7 +1715,7 @@ Setup_Dump::Setup_Dump(int dump_size, const unsigned char* dump_data)
 	data = 0;
 	if (dump_data)
 	{
-		data = new unsigned char[size];
+		data = dump_buffer_alloc(size);
 		memcpy(data, dump_data, size);
 		setup_dump_info[0] = data[7] * 128 + data[6]; // # general
 		setup_dump_info[1] = data[9] * 128 + data[8]; // # master
@@ -1341,7 +1732,7 @@ Setup_Dump::Setup_Dump(int dump_size, const unsigned char* dump_data)
 Setup_Dump::~Setup_Dump()
 {
 	pmesg("Setup_Dump::~Setup_Dump()\n");
-	delete[] data;
+	dump_buffer_free(data, size);
 }
 
 int Setup_Dump::get_value(int id, int channel) const
@@ -1387,16 +1778,18 @@ int Setup_Dump::set_value(int id, int value, int channel)
 void Setup_Dump::show() const
 {
 	pmesg("Setup_Dump::show()\n");
-	int i = 140;
+	int first = 140;
 	if (pxk->midi_mode != MULTI)
-		i = 141;
+		first = 141;
 	// first fill the arp browser
 	pwid[660][0]->set_value(get_value(660));
-	for (; i <= 787; i++)
+	const std::vector<pwid_entry>& params = pwid_registry.group(PWID_SETUP);
+	for (size_t i = 0; i < params.size(); i++)
 	{
-		// skip fx and browsers
-		if (pwid[i][0] && (!((i > 512 && i < 529) || i == 660)))
-			pwid[i][0]->set_value(get_value(i));
+		// skip channel parameters and browsers
+		if (params[i].id < first || params[i].id == 660)
+			continue;
+		params[i].widget->set_value(get_value(params[i].id));
 	}
 	if (pxk->midi_mode == MULTI && pxk->selected_fx_channel == -1)
 		show_fx();
@@ -1405,8 +1798,9 @@ void Setup_Dump::show() const
 void Setup_Dump::show_fx() const
 {
 	pmesg("Setup_Dump::show_fx()\n");
-	for (int i = 513; i < 529; i++)
-		pwid[i][0]->set_value(get_value(i));
+	const std::vector<pwid_entry>& fx = pwid_registry.group(PWID_FX_MASTER);
+	for (size_t i = 0; i < fx.size(); i++)
+		fx[i].widget->set_value(get_value(fx[i].id));
 }
 
 void Setup_Dump::upload() const
@@ -1525,6 +1919,8 @@ ROM::ROM(int i, int pr, int in)
 	arp_names = 0;
 	arp_names_changed = false;
 	riff_names = 0;
+	for (int i = 0; i <= RIFF; i++)
+		name_indexes[i] = 0;
 	const char* rom_name = name();
 	ui->preset_rom->add(rom_name);
 	ui->preset_editor->l1_rom->add(rom_name);
@@ -1586,6 +1982,8 @@ ROM::~ROM()
 	delete[] preset_names;
 	delete[] arp_names;
 	delete[] riff_names;
+	for (int i = 0; i <= RIFF; i++)
+		delete name_indexes[i];
 }
 
 void ROM::save(unsigned char type)
@@ -1687,6 +2085,8 @@ int ROM::disk_load_names(unsigned char type)
 		}
 		*number = size / 16;
 		*data = new unsigned char[size];
+		delete name_indexes[type];
+		name_indexes[type] = 0;
 		file.seekg(0, std::ios::beg);
 		file.read((char*) *data, size);
 		file.close();
@@ -1782,9 +2182,32 @@ int ROM::set_name(int type, int number, const unsigned char* name)
 			pxk->display_status("ROM::set_name() Unknown ROM.");
 			return 0;
 	}
+	if (name_indexes[type])
+		name_indexes[type]->set(number, get_name(type, number));
 	return 1;
 }
 
+Name_Index* ROM::name_index(int type)
+{
+	if (type != PRESET && type != INSTRUMENT && type != ARP && type != RIFF)
+		return 0;
+	int number = get_attribute(type);
+	if (number <= 0 || !get_name(type, 0))
+		return 0;
+	if (name_indexes[type] && name_indexes[type]->size() != number)
+	{
+		delete name_indexes[type];
+		name_indexes[type] = 0;
+	}
+	if (!name_indexes[type])
+	{
+		name_indexes[type] = new Name_Index(type == INSTRUMENT ? 4 : 3);
+		for (int i = 0; i < number; i++)
+			name_indexes[type]->set(i, get_name(type, i));
+	}
+	return name_indexes[type];
+}
+
 const unsigned char* ROM::get_name(int type, int number) const
 {
 	//pmesg("ROM::get_name(type: %d, #: %d)  \n", type, number);
@@ -0,0 +1,161 @@
+/*
+ This file is part of prodatum.
+ Copyright 2011-2015 Jan Eidtmann
+
+ prodatum is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ prodatum is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with prodatum.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include <vector>
+
+#include "journal.h"
+#include "bank.h"
+#include "debug.h"
+
+Transfer_Journal::Transfer_Journal() :
+		file(0), failed(false), job(0)
+{
+}
+
+Transfer_Journal::~Transfer_Journal()
+{
+	close();
+}
+
+long Transfer_Journal::key(int type, int rom, int slot)
+{
+	return ((long) type << 24) | ((rom & 0xff) << 16) | (slot & 0xffff);
+}
+
+bool Transfer_Journal::open(const std::string& filename, const std::string& signature)
+{
+	pmesg("Transfer_Journal::open(%s)\n", filename.c_str());
+	close();
+	path = filename;
+	failed = false;
+	job = bank_checksum((const unsigned char*) signature.data(), signature.size());
+	// load a previous run: "job signature" followed by "type rom slot checksum file"
+	FILE* f = fopen(filename.c_str(), "r");
+	if (f)
+	{
+		char line[1200];
+		unsigned int previous;
+		if (fgets(line, sizeof(line), f) && sscanf(line, "job %x", &previous) == 1 && previous == job)
+			while (fgets(line, sizeof(line), f))
+			{
+				int type, rom, slot, n = 0;
+				unsigned int checksum;
+				if (sscanf(line, "%d %d %d %x %n", &type, &rom, &slot, &checksum, &n) < 4)
+					continue;
+				journal_entry e;
+				e.checksum = checksum;
+				e.file = line + n;
+				while (!e.file.empty() && (e.file[e.file.size() - 1] == '\n' || e.file[e.file.size() - 1] == '\r'))
+					e.file.erase(e.file.size() - 1);
+				completed[key(type, rom, slot)] = e;
+			}
+		fclose(f);
+	}
+	if (completed.empty())
+		return create();
+	file = fopen(filename.c_str(), "a");
+	return file != 0;
+}
+
+size_t Transfer_Journal::resumable() const
+{
+	return completed.size();
+}
+
+bool Transfer_Journal::restart()
+{
+	if (file)
+		fclose(file);
+	completed.clear();
+	return create();
+}
+
+bool Transfer_Journal::create()
+{
+	file = fopen(path.c_str(), "w");
+	if (!file)
+		return false;
+	fprintf(file, "job %08x\n", job);
+	fflush(file);
+	return true;
+}
+
+void Transfer_Journal::close()
+{
+	if (file)
+		fclose(file);
+	file = 0;
+	completed.clear();
+}
+
+bool Transfer_Journal::is_open() const
+{
+	return file != 0;
+}
+
+void Transfer_Journal::add(int type, int rom, int slot, unsigned int checksum, const std::string& saved_file)
+{
+	if (!file)
+		return;
+	journal_entry e;
+	e.checksum = checksum;
+	e.file = saved_file;
+	completed[key(type, rom, slot)] = e;
+	fprintf(file, "%d %d %d %08x %s\n", type, rom, slot, checksum, saved_file.c_str());
+	// survive a crash
+	fflush(file);
+}
+
+const journal_entry* Transfer_Journal::find(int type, int rom, int slot) const
+{
+	std::map<long, journal_entry>::const_iterator it = completed.find(key(type, rom, slot));
+	if (it == completed.end())
+		return 0;
+	return &it->second;
+}
+
+void Transfer_Journal::fail()
+{
+	failed = true;
+}
+
+void Transfer_Journal::finish()
+{
+	if (!file)
+		return;
+	close();
+	if (!failed)
+		remove(path.c_str());
+}
+
+bool file_checksum(const std::string& filename, unsigned int* checksum)
+{
+	FILE* f = fopen(filename.c_str(), "rb");
+	if (!f)
+		return false;
+	std::vector<unsigned char> data;
+	unsigned char buf[4096];
+	size_t n;
+	while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+		data.insert(data.end(), buf, buf + n);
+	fclose(f);
+	*checksum = bank_checksum(data.empty() ? buf : &data[0], data.size());
+	return true;
+}
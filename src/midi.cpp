@@ -79,6 +79,108 @@ static jack_ringbuffer_t *write_buffer;
 volatile static unsigned char midi_device_id = 127;
 static bool requested = false;
 
+/// a queued parameter edit, see \c MIDI::queue_parameter_value
+struct queued_edit
+{
+	int id;
+	int value;
+	int layer;
+};
+static std::vector<queued_edit> queued_edits;
+/// layer currently selected on the device (-1 = all layers, -3 = unknown)
+static int device_layer = -3;
+
+// ###############
+// incoming notes and controllers
+// #################
+/// incoming notes and controllers are shown at most this often per second
+#define EVENT_FRAME_RATE 50
+/// a note for the pianos, see \c Piano::activate_key
+struct pending_note
+{
+	char value;
+	unsigned char key;
+};
+static std::vector<pending_note> pending_notes;
+/// latest value + 1 of each controller since the last frame (0 = unchanged)
+static int pending_cc[128];
+/// latest pitchwheel value + 1 (0 = unchanged)
+static int pending_pitch = 0;
+static bool frame_scheduled = false;
+
+/**
+ * shows the notes and controllers that arrived since the last frame.
+ * the pianos keep the key states of all notes but only redraw if they
+ * are visible, controllers are set once with their latest value
+ */
+static void show_events(void*)
+{
+	frame_scheduled = false;
+	for (size_t i = 0; i < pending_notes.size(); i++)
+	{
+		const pending_note& n = pending_notes[i];
+		ui->piano->activate_key(n.value, n.key);
+		ui->main->minipiano->activate_key(n.value, n.key);
+		ui->global_minipiano->activate_key(n.value, n.key);
+		ui->arp_mp->activate_key(n.value, n.key);
+	}
+	pending_notes.clear();
+	for (int cc = 0; cc < 128; cc++)
+	{
+		if (!pending_cc[cc])
+			continue;
+		int value = pending_cc[cc] - 1;
+		pending_cc[cc] = 0;
+		if (pxk->cc_to_ctrl.find(cc) != pxk->cc_to_ctrl.end())
+		{
+			int controller = pxk->cc_to_ctrl[cc];
+			if (controller <= 12)
+				// sliders
+				((Fl_Slider*) ui->main->ctrl_x[controller])->value((double) value);
+			else
+				// footswitches
+				((Fl_Button*) ui->main->ctrl_x[controller])->value(value > 63 ? 1 : 0);
+		}
+		else if (cc == 1) // modwhl
+			ui->modwheel->value((double) value);
+		else if (cc == 7) // channel volume
+			pwid[131][0]->set_value(value);
+		else if (cc == 10) // channel pan
+			pwid[132][0]->set_value(value);
+	}
+	if (pending_pitch)
+	{
+		ui->pitchwheel->value((double) (pending_pitch - 1));
+		pending_pitch = 0;
+	}
+}
+
+static void schedule_frame()
+{
+	if (frame_scheduled)
+		return;
+	frame_scheduled = true;
+	Fl::add_timeout(1. / EVENT_FRAME_RATE, show_events);
+}
+
+static void queue_note(char value, unsigned char key)
+{
+	pending_note n =
+	{ value, key };
+	pending_notes.push_back(n);
+	schedule_frame();
+}
+
+/// drops notes and controllers that were not shown yet
+static void drop_events()
+{
+	Fl::remove_timeout(show_events);
+	frame_scheduled = false;
+	pending_notes.clear();
+	memset(pending_cc, 0, sizeof(pending_cc));
+	pending_pitch = 0;
+}
+
 static void show_error(void)
 {
 	char* __buffer = (char*) malloc(256 * sizeof(char));
@@ -288,7 +390,6 @@ static void process_midi_in(int fd, void*)
 static void process_midi_in(void*)
 #endif
 {
-	static unsigned long count_events = 0;
 	static unsigned char sysex[SYSEX_MAX_SIZE];
 	static unsigned int len;
 	unsigned char poll = 0;
@@ -313,14 +414,20 @@ static void process_midi_in(void*)
 				switch (sysex[5])
 				{
 					case 0x0b: // generic name
-						if (!pxk->Synchronized())
+						if (pxk->calibrating())
+							pxk->incoming_calibration(sysex, len);
+						else if (!pxk->Synchronized())
 						{
 							got_answer = true;
 							pxk->incoming_generic_name(sysex);
 						}
+						else
+							pxk->preset_upload_settled();
 						break;
 					case 0x10: // preset dumps
-						if (requested)
+						if (pxk->calibrating())
+							pxk->incoming_calibration(sysex, len);
+						else if (requested)
 							switch (sysex[6])
 							{
 								case 0x01: // dump header (closed)
@@ -336,6 +443,7 @@ static void process_midi_in(void*)
 									{
 										got_answer = true;
 										requested = false;
+										pxk->preset_dump_complete();
 									}
 									break;
 							}
@@ -352,6 +460,7 @@ static void process_midi_in(void*)
 					case 0x7b: // EOF
 						got_answer = true;
 						requested = false;
+						pxk->preset_dump_complete();
 						break;
 
 					case 0x1c: // setup dumps
@@ -364,7 +473,7 @@ static void process_midi_in(void*)
 						break;
 
 					case 0x18: // arp pattern dump
-						if (requested)
+						if (requested || pxk->arp_transfer_pending())
 						{
 							got_answer = true;
 							requested = false;
@@ -435,123 +544,35 @@ static void process_midi_in(void*)
 		{
 			unsigned char event[4];
 			jack_ringbuffer_read(read_buffer, event, 4);
-			if (event[3] == 0) // device event
+			// device events (1 = on, -1 = off) and controller events (2 = on, -2/-3 = off)
+			bool device = event[3] == 0;
+			switch (event[0] >> 4)
 			{
-				switch (event[0] >> 4)
-				{
-					case 0x8: // note off
-						ui->piano->activate_key(-1, event[1]);
-						ui->main->minipiano->activate_key(-1, event[1]);
-						ui->global_minipiano->activate_key(-1, event[1]);
-						ui->arp_mp->activate_key(-1, event[1]);
-						break;
-					case 0x9: // note-on
-						if (event[2] == 0)
-						{
-							ui->piano->activate_key(-1, event[1]);
-							ui->main->minipiano->activate_key(-1, event[1]);
-							ui->global_minipiano->activate_key(-1, event[1]);
-							ui->arp_mp->activate_key(-1, event[1]);
-						}
-						else
-						{
-							ui->piano->activate_key(1, event[1]);
-							ui->main->minipiano->activate_key(1, event[1]);
-							ui->global_minipiano->activate_key(1, event[1]);
-							ui->arp_mp->activate_key(1, event[1]);
-						}
-						break;
-					case 0xb: // controller event
-					{
-						if (pxk->cc_to_ctrl.find(event[1]) != pxk->cc_to_ctrl.end())
-						{
-							int controller = pxk->cc_to_ctrl[event[1]];
-							if (controller <= 12)
-								// sliders
-								((Fl_Slider*) ui->main->ctrl_x[controller])->value((double) event[2]);
-							else
-								// footswitches
-								((Fl_Button*) ui->main->ctrl_x[controller])->value(event[2] > 63 ? 1 : 0);
-						}
-						else if (event[1] == 1) // modwhl
-							ui->modwheel->value((double) event[2]);
-						else if (event[1] == 7) // channel volume
-							pwid[131][0]->set_value(event[2]);
-						else if (event[1] == 10) // channel pan
-							pwid[132][0]->set_value(event[2]);
-					}
-						break;
-					case 0xe: // pitchwheel
-					{
-						int v = event[2];
-						v <<= 7;
-						v |= event[1];
-						ui->pitchwheel->value((double) v);
-					}
-				}
-			}
-			else // controller event
-			{
-				switch (event[0] >> 4)
+				case 0x8: // note off
+					queue_note(device ? -1 : -3, event[1]);
+					break;
+				case 0x9: // note-on
+					if (event[2] == 0)
+						queue_note(device ? -1 : -2, event[1]);
+					else
+						queue_note(device ? 1 : 2, event[1]);
+					break;
+				case 0xb: // controller event
+					pending_cc[event[1] & 0x7f] = event[2] + 1;
+					schedule_frame();
+					break;
+				case 0xe: // pitchwheel
 				{
-					case 0x8: // note off
-						ui->piano->activate_key(-3, event[1]);
-						ui->main->minipiano->activate_key(-3, event[1]);
-						ui->global_minipiano->activate_key(-3, event[1]);
-						ui->arp_mp->activate_key(-3, event[1]);
-						break;
-					case 0x9: // note-on
-						if (event[2] == 0)
-						{
-							ui->piano->activate_key(-2, event[1]);
-							ui->main->minipiano->activate_key(-2, event[1]);
-							ui->global_minipiano->activate_key(-2, event[1]);
-							ui->arp_mp->activate_key(-2, event[1]);
-						}
-						else
-						{
-							ui->piano->activate_key(2, event[1]);
-							ui->main->minipiano->activate_key(2, event[1]);
-							ui->global_minipiano->activate_key(2, event[1]);
-							ui->arp_mp->activate_key(2, event[1]);
-						}
-						break;
-					case 0xb: // controller event
-					{
-						if (pxk->cc_to_ctrl.find(event[1]) != pxk->cc_to_ctrl.end())
-						{
-							int controller = pxk->cc_to_ctrl[event[1]];
-							if (controller <= 12)
-								// sliders
-								((Fl_Slider*) ui->main->ctrl_x[controller])->value((double) event[2]);
-							else
-								// footswitches
-								((Fl_Button*) ui->main->ctrl_x[controller])->value(event[2] > 63 ? 1 : 0);
-						}
-						else if (event[1] == 1) // modwhl
-							ui->modwheel->value((double) event[2]);
-						else if (event[1] == 7) // channel volume
-							pwid[131][0]->set_value(event[2]);
-						else if (event[1] == 10) // channel pan
-							pwid[132][0]->set_value(event[2]);
-					}
-						break;
-					case 0xe: // pitchwheel
-					{
-						int v = event[2];
-						v <<= 7;
-						v |= event[1];
-						ui->pitchwheel->value((double) v);
-					}
+					int v = event[2];
+					v <<= 7;
+					v |= event[1];
+					pending_pitch = v + 1;
+					schedule_frame();
 				}
 			}
 			// log midi events
 			if (cfg->get_cfg_option(CFG_LOG_EVENTS_IN))
-			{
-				char _b[30];
-				snprintf(_b, 30, "\nIE.%lu::%02X%02X%02X", ++count_events, event[0], event[1], event[2]);
-				ui->logbuf->append(_b);
-			}
+				ui->logbuf->add(LOG_EVENT_IN, event, 3);
 		}
 	}
 #ifndef __linux
@@ -645,6 +666,7 @@ void MIDI::set_device_id(unsigned char id)
 {
 	pmesg("MIDI::set_device_id(%d)\n", id);
 	midi_device_id = id;
+	device_layer = -3;
 	// sysex packet delay
 	edit_parameter_value(405, cfg->get_cfg_option(CFG_SPEED));
 }
@@ -696,6 +718,7 @@ void MIDI::stop_timer()
 	midi_active = false;
 	while (!process_midi_exit_flag)
 		mysleep(10);
+	drop_events();
 #ifdef __linux
 	Fl::remove_fd(p[0]);
 	close(p[0]);
@@ -955,6 +978,9 @@ void MIDI::write_sysex(const unsigned char* sysex, unsigned int len) const
 	static unsigned char data[SYSEX_MAX_SIZE];
 	if (!midi_active || len > SYSEX_MAX_SIZE)
 		return;
+	// keep the order of queued edits and everything else
+	if (!queued_edits.empty())
+		flush_parameter_values();
 	data[0] = MIDI_SYSEX;
 	data[1] = len / 128;
 	data[2] = len % 128;
@@ -976,6 +1002,8 @@ void MIDI::write_event(int status, int value1, int value2, int channel) const
 	//pmesg("MIDI::write_event(%X, %X, %X, %d)\n", status, value1, value2, channel);
 	if (!midi_active)
 		return;
+	if (!queued_edits.empty())
+		flush_parameter_values();
 	if (channel == -1)
 		channel = pxk->selected_channel;
 	unsigned char stat = ((status & ~0xf) | channel) & 0xff;
@@ -988,12 +1016,7 @@ void MIDI::write_event(int status, int value1, int value2, int channel) const
 	jack_ringbuffer_write(write_buffer, msg, 3);
 	// log midi events
 	if (cfg->get_cfg_option(CFG_LOG_EVENTS_OUT))
-	{
-		static unsigned long count = 0;
-		char buf[30];
-		snprintf(buf, 30, "\nOE.%lu::%02x%02x%02x", ++count, stat, v1, v2);
-		ui->logbuf->append(buf);
-	}
+		ui->logbuf->add(LOG_EVENT_OUT, msg, 3);
 }
 
 void MIDI::ack(int packet) const
@@ -1073,6 +1096,30 @@ void MIDI::request_preset_dump(int timeout) const
 	requested = true;
 }
 
+void MIDI::request_edit_buffer_dump() const
+{
+	pmesg("MIDI::request_edit_buffer_dump() \n");
+	unsigned char request[] =
+		{ 0xf0, 0x18, 0x0f, midi_device_id, 0x55, 0x11, 0x04, 0x7f, 0x7f, 0, 0, 0xf7 };
+	write_sysex(request, 12);
+}
+
+void MIDI::request_slot_dump(int number, int rom_id) const
+{
+	pmesg("MIDI::request_slot_dump(#: %d, rom: %d) \n", number, rom_id);
+	unsigned char loop = cfg->get_cfg_option(CFG_CLOSED_LOOP_DOWNLOAD) ? 0x02 : 0x04;
+	unsigned char request[] =
+		{ 0xf0, 0x18, 0x0f, midi_device_id, 0x55, 0x11, loop, (unsigned char) (number % 128),
+				(unsigned char) (number / 128), (unsigned char) (rom_id % 128), (unsigned char) (rom_id / 128), 0xf7 };
+	write_sysex(request, 12);
+	requested = true;
+}
+
+bool MIDI::request_pending() const
+{
+	return requested;
+}
+
 void MIDI::request_setup_dump() const
 {
 	pmesg("MIDI::request_setup_dump() \n");
@@ -1131,6 +1178,116 @@ void MIDI::edit_parameter_value(int id, int value) const
 	unsigned char request[] =
 	{ 0xf0, 0x18, 0x0f, midi_device_id, 0x55, 0x01, 0x02, il, im, vl, vm, 0xf7 };
 	write_sysex(request, 12);
+	if (id == 898)
+		device_layer = (value > 8191) ? value - 16384 : value;
+}
+
+void MIDI::edit_parameter_values(const int* ids, const int* values, int count) const
+{
+	//pmesg("MIDI::edit_parameter_values(ids, values, count: %d) \n", count);
+	if (count == 1)
+	{
+		edit_parameter_value(*ids, *values);
+		return;
+	}
+	unsigned char m[255];
+	m[0] = 0xf0;
+	m[1] = 0x18;
+	m[2] = 0x0f;
+	m[3] = midi_device_id;
+	m[4] = 0x55;
+	m[5] = 0x01;
+	int sent = 0;
+	while (sent < count)
+	{
+		int pairs = count - sent;
+		if (pairs > 41)
+			pairs = 41;
+		for (int i = 0; i < pairs; i++)
+		{
+			int id = ids[sent + i];
+			int value = values[sent + i];
+			if (id < 0)
+				id += 16384;
+			if (value < 0)
+				value += 16384;
+			if (id == 898)
+				device_layer = (value > 8191) ? value - 16384 : value;
+			m[7 + 4 * i] = id % 128;
+			m[8 + 4 * i] = id / 128;
+			m[9 + 4 * i] = value % 128;
+			m[10 + 4 * i] = value / 128;
+		}
+		m[6] = pairs * 2;
+		m[7 + 4 * pairs] = 0xf7;
+		write_sysex(m, 8 + 4 * pairs);
+		sent += pairs;
+	}
+}
+
+/// timer rounds the queued edits waited for the write buffer to drain
+static unsigned char flush_waited = 0;
+
+// sends queued edits once the write buffer drained (or we waited long enough)
+static void flush_queued_edits(void* p)
+{
+	if (jack_ringbuffer_read_space(write_buffer) && ++flush_waited < 5)
+	{
+		Fl::repeat_timeout(.01, flush_queued_edits, p);
+		return;
+	}
+	((const MIDI*) p)->flush_parameter_values();
+}
+
+void MIDI::queue_parameter_value(int id, int value, int layer) const
+{
+	//pmesg("MIDI::queue_parameter_value(id: %d, value: %d, layer: %d) \n", id, value, layer);
+	if (!midi_active)
+		return;
+	bool scheduled = !queued_edits.empty();
+	// the last value goes to the back, after the parameters it depends on
+	for (unsigned int i = 0; i < queued_edits.size(); i++)
+		if (queued_edits[i].id == id && queued_edits[i].layer == layer)
+		{
+			queued_edits.erase(queued_edits.begin() + i);
+			break;
+		}
+	queued_edit e;
+	e.id = id;
+	e.value = value;
+	e.layer = layer;
+	if (!scheduled)
+		Fl::add_timeout(.01, flush_queued_edits, (void*) this);
+	queued_edits.push_back(e);
+	// 41 pairs fit in one message, leave some room for layer selects
+	if (queued_edits.size() >= 36)
+		flush_parameter_values();
+}
+
+void MIDI::flush_parameter_values() const
+{
+	Fl::remove_timeout(flush_queued_edits);
+	flush_waited = 0;
+	if (queued_edits.empty())
+		return;
+	std::vector<queued_edit> edits;
+	edits.swap(queued_edits);
+	std::vector<int> ids;
+	std::vector<int> values;
+	int layer = device_layer;
+	for (unsigned int i = 0; i < edits.size(); i++)
+	{
+		// select the layer only if we need to
+		if (edits[i].layer != -2 && edits[i].layer != layer)
+		{
+			layer = edits[i].layer;
+			ids.push_back(898);
+			values.push_back(layer);
+		}
+		ids.push_back(edits[i].id);
+		values.push_back(edits[i].value);
+	}
+	edit_parameter_values(&ids[0], &values[0], ids.size());
 }
 
 void MIDI::master_volume(int volume) const
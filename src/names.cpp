@@ -0,0 +1,135 @@
+/*
+ This file is part of prodatum.
+ Copyright 2011-2015 Jan Eidtmann
+
+ prodatum is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ prodatum is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with prodatum.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <algorithm>
+
+#include "names.h"
+#include "debug.h"
+
+static std::string fold(const char* s, size_t len)
+{
+	std::string f(s, len);
+	for (size_t i = 0; i < f.size(); i++)
+		f[i] = tolower((unsigned char) f[i]);
+	return f;
+}
+
+static unsigned int trigram(const char* s)
+{
+	return ((unsigned char) s[0] << 16) | ((unsigned char) s[1] << 8) | (unsigned char) s[2];
+}
+
+Name_Index::Name_Index(int d) :
+		digits(d)
+{
+}
+
+void Name_Index::index_row(int row, bool add)
+{
+	const std::string& s = rows[row];
+	for (size_t i = 0; i + 2 < s.size(); i++)
+	{
+		std::vector<int>& p = trigrams[trigram(s.c_str() + i)];
+		std::vector<int>::iterator it = std::lower_bound(p.begin(), p.end(), row);
+		bool present = it != p.end() && *it == row;
+		if (add && !present)
+			p.insert(it, row);
+		else if (!add && present)
+			p.erase(it);
+	}
+}
+
+void Name_Index::set(int row, const unsigned char* name)
+{
+	if (row < 0)
+		return;
+	if (row >= (int) rows.size())
+		rows.resize(row + 1);
+	else
+		index_row(row, false);
+	char buf[24];
+	int n = snprintf(buf, 24, "%0*d ", digits, row);
+	if (n > 23)
+		n = 23;
+	size_t len = 0;
+	if (name)
+		while (len < 16 && name[len])
+			++len;
+	rows[row] = fold(buf, n) + fold((const char*) name, len);
+	index_row(row, true);
+	cache.clear();
+}
+
+int Name_Index::size() const
+{
+	return rows.size();
+}
+
+const std::vector<int>& Name_Index::match(const char* query)
+{
+	std::string q = fold(query, strlen(query));
+	for (size_t i = 0; i < cache.size(); i++)
+		if (cache[i].query == q)
+			return cache[i].rows;
+	// narrow the closest previous result
+	const std::vector<int>* base = 0;
+	size_t base_len = 0;
+	for (size_t i = 0; i < cache.size(); i++)
+		if (cache[i].query.size() >= base_len && q.find(cache[i].query) != std::string::npos)
+		{
+			base = &cache[i].rows;
+			base_len = cache[i].query.size();
+		}
+	// or the rarest trigram of the query
+	std::vector<int> all;
+	if (!base && q.size() >= 3)
+	{
+		static const std::vector<int> none;
+		for (size_t i = 0; i + 2 < q.size(); i++)
+		{
+			std::map<unsigned int, std::vector<int> >::const_iterator it = trigrams.find(trigram(q.c_str() + i));
+			const std::vector<int>* p = it == trigrams.end() ? &none : &it->second;
+			if (!base || p->size() < base->size())
+				base = p;
+		}
+	}
+	else if (!base)
+	{
+		all.resize(rows.size());
+		for (size_t i = 0; i < rows.size(); i++)
+			all[i] = i;
+		base = &all;
+	}
+	result r;
+	r.query = q;
+	for (size_t i = 0; i < base->size(); i++)
+		if (rows[(*base)[i]].find(q) != std::string::npos)
+			r.rows.push_back((*base)[i]);
+	if (cache.size() >= NAME_INDEX_CACHE)
+		cache.pop_front();
+	cache.push_back(r);
+	return cache.back().rows;
+}
+
+bool Name_Index::contains(const char* text, const char* query)
+{
+	return fold(text, strlen(text)).find(fold(query, strlen(query))) != std::string::npos;
+}
@@ -0,0 +1,252 @@
+/*
+ This file is part of prodatum.
+ Copyright 2011-2015 Jan Eidtmann
+
+ prodatum is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ prodatum is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with prodatum.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fstream>
+
+#include "data.h"
+#include "prefetch.h"
+
+File_Prefetcher::File_Prefetcher() :
+		next_file(0), taken(0), ahead(PREFETCH_AHEAD), type(PRESET), stopping(false)
+{
+}
+
+File_Prefetcher::~File_Prefetcher()
+{
+	stop();
+	for (size_t i = 0; i < buffers.size(); i++)
+		delete[] buffers[i];
+}
+
+void File_Prefetcher::start(const std::vector<std::string>& file_list, int dump_type, size_t read_ahead)
+{
+	stop();
+	std::lock_guard<std::mutex> l(lock);
+	files = file_list;
+	next_file = 0;
+	taken = 0;
+	ahead = read_ahead > 0 ? read_ahead : 1;
+	type = dump_type;
+	stopping = false;
+	reader = std::thread(&File_Prefetcher::run, this);
+}
+
+void File_Prefetcher::stop_reader()
+{
+	{
+		std::lock_guard<std::mutex> l(lock);
+		stopping = true;
+	}
+	changed.notify_all();
+	if (reader.joinable())
+		reader.join();
+}
+
+void File_Prefetcher::stop()
+{
+	stop_reader();
+	archive.close();
+	std::lock_guard<std::mutex> l(lock);
+	while (!ready.empty())
+	{
+		if (ready.front().sysex)
+			buffers.push_back(ready.front().sysex);
+		ready.pop_front();
+	}
+	files.clear();
+	next_file = 0;
+	taken = 0;
+}
+
+size_t File_Prefetcher::remaining() const
+{
+	std::lock_guard<std::mutex> l(lock);
+	return files.size() - taken;
+}
+
+void File_Prefetcher::run()
+{
+	std::unique_lock<std::mutex> l(lock);
+	while (!stopping && next_file < files.size())
+	{
+		if (ready.size() >= ahead)
+		{
+			changed.wait(l);
+			continue;
+		}
+		std::string filename = files[next_file++];
+		unsigned char* buffer;
+		if (buffers.empty())
+			buffer = new unsigned char[PREFETCH_BUFFER_SIZE];
+		else
+		{
+			buffer = buffers.back();
+			buffers.pop_back();
+		}
+		// don't hold the lock while we wait for the disk
+		l.unlock();
+		prefetched_file f;
+		read_file(filename, &f, buffer);
+		l.lock();
+		if (!f.sysex)
+			buffers.push_back(buffer);
+		ready.push_back(f);
+		changed.notify_all();
+	}
+}
+
+std::string File_Prefetcher::local_path(const std::string& filename)
+{
+#ifdef __linux
+	size_t offset = 0;
+	while (offset < filename.size() && filename[offset] != '/')
+		++offset;
+	std::string n(filename, offset);
+	while (!n.empty() && (n[n.size() - 1] == '\n' || n[n.size() - 1] == '\r' || n[n.size() - 1] == ' '))
+		n.erase(n.size() - 1);
+	return n;
+#else
+	return filename;
+#endif
+}
+
+std::string File_Prefetcher::archive_entry(const std::string& archive, int entry)
+{
+	char buf[16];
+	snprintf(buf, 16, "#%d", entry);
+	return local_path(archive) + buf;
+}
+
+void File_Prefetcher::read_file(const std::string& filename, prefetched_file* f, unsigned char* buffer)
+{
+	f->filename = filename;
+	f->sysex = 0;
+	f->size = 0;
+	f->packet_size = 0;
+	f->error = 0;
+
+	// entry of a bank archive?
+	const unsigned char* entry = 0;
+	std::ifstream file;
+	int size;
+	size_t hash = filename.rfind('#');
+	if (hash != std::string::npos && Bank_Archive::is_archive(filename.substr(0, hash).c_str()))
+	{
+		std::string name(filename, 0, hash);
+		if (!archive.is_open() || archive.filename() != name)
+			archive.open(name.c_str());
+		int i = atoi(filename.c_str() + hash + 1);
+		entry = archive.dump(i);
+		if (!entry)
+		{
+			f->error = "Bank archive entry is damaged";
+			return;
+		}
+		size = archive.entry(i)->length;
+	}
+	else
+	{
+		// check and load file
+		file.open(local_path(filename).c_str(), std::ifstream::binary);
+		file.seekg(0, std::ios::end);
+		size = file.tellg();
+		file.seekg(0, std::ios::beg);
+	}
+	unsigned char dump_type;
+	bool size_ok;
+	switch (type)
+	{
+		case ARP:
+			dump_type = 0x18;
+			size_ok = size == 285;
+			break;
+		case SETUP:
+			dump_type = 0x1c;
+			size_ok = size >= 975 && size <= 981; // a2k setup size unknown - need to verify
+			break;
+		default:
+			dump_type = 0x10;
+			size_ok = size >= 1605 && size <= 1615;
+			break;
+	}
+	if (!size_ok)
+	{
+		f->error = "File size incorrect";
+		return;
+	}
+	if (entry)
+		memcpy(buffer, entry, size);
+	else
+		file.read((char*) buffer, size);
+	if ((!entry && !file) || !(buffer[0] == 0xf0 && buffer[1] == 0x18 && buffer[2] == 0x0f && buffer[4] == 0x55 && buffer[5] == dump_type
+			&& buffer[size - 1] == 0xf7))
+	{
+		switch (type)
+		{
+			case ARP:
+				f->error = "Sysex is not an arp";
+				break;
+			case SETUP:
+				f->error = "Sysex is not a setup";
+				break;
+			default:
+				f->error = "Sysex is not a preset";
+		}
+		return;
+	}
+	if (type == PRESET)
+	{
+		// find packet size
+		int pos = DUMP_HEADER_SIZE; // start after the header
+		while (++pos < size) // calculate packet size
+			if (buffer[pos] == 0xf7)
+				break;
+		f->packet_size = pos - DUMP_HEADER_SIZE + 1;
+	}
+	f->sysex = buffer;
+	f->size = size;
+}
+
+bool File_Prefetcher::next(prefetched_file* f)
+{
+	std::unique_lock<std::mutex> l(lock);
+	if (taken >= files.size())
+		return false;
+	while (ready.empty() && !stopping)
+		changed.wait(l);
+	if (ready.empty())
+		return false;
+	*f = ready.front();
+	ready.pop_front();
+	++taken;
+	// make room for the reader
+	changed.notify_all();
+	return true;
+}
+
+void File_Prefetcher::release(prefetched_file* f)
+{
+	if (!f->sysex)
+		return;
+	std::lock_guard<std::mutex> l(lock);
+	buffers.push_back(f->sysex);
+	f->sysex = 0;
+}
@@ -90,6 +90,7 @@ int main(int argc, char *argv[])
 	ui = new PD_UI();
 	if (!ui)
 		return 1;
+	pwid_registry.build();
 	cfg = new Cfg(__device);
 	if (!cfg)
 		return 2;
@@ -215,6 +216,7 @@ void PD_UI::set_color(Fl_Color t)
 	if (!fl_color_chooser("New color:", r, g, b))
 		return;
 	Fl::set_color(t, r, g, b);
+	Fl_Knob::clear_sprites();
 	if (t == FL_INACTIVE_COLOR)
 		Fl_Tooltip::textcolor(t);
 	else if (t == FL_BACKGROUND2_COLOR)
@@ -308,6 +310,7 @@ void PD_UI::set_knobcolor(char type, char color)
 			((Fl_Button*) g->child(4))->setonly();
 			break;
 	}
+	Fl_Knob::clear_sprites();
 	Fl::reload_scheme();
 }
 
@@ -17,14 +17,22 @@
  */
 
 #include <string.h>
+#include <time.h>
+#include <ctype.h>
 #include <fstream>
+#include <deque>
 #include <FL/fl_ask.H>
 #include <FL/Fl_Tooltip.H>
 #include <FL/Fl_File_Chooser.H>
 #include <FL/Fl_Text_Editor.H>
+#include <FL/Fl_Check_Button.H>
 
 #include "config.h"
 #include "pxk.h"
+#include "prefetch.h"
+#include "bank.h"
+#include "journal.h"
+#include "telemetry.h"
 
 extern PD_UI* ui;
 extern PXK* pxk;
@@ -48,8 +56,134 @@ volatile static bool name_set_incomplete;
 volatile static int init_progress;
 
 volatile static bool moar_files = false;
+// bulk preset download in progress
+static bool downloading_presets = false;
+// retries of the current slot of a bulk preset download
+static unsigned char download_retries = 0;
+// bulk preset upload in progress
+static bool uploading_presets = false;
+// slot of the preset we uploaded last, waiting for the device to settle if >= 0
+static int settling_slot = -1;
+// reads the files of bulk imports ahead of the uploader
+static File_Prefetcher prefetcher;
+// bulk exports go here instead of single files if it is open
+static Bank_Archive bank;
+// completed slots of the running bulk job
+static Transfer_Journal journal;
+// checksum of the preset file we uploaded last
+static unsigned int settling_checksum = 0;
+// target slots of a re-queued upload (instead of the preset offset)
+static std::deque<int> upload_slots;
+// read-back verification of bulk preset uploads
+// times a failed slot is uploaded again
+#define VERIFY_ROUNDS 2
+struct verify_item
+{
+	int slot;
+	unsigned int checksum;
+	std::string file;
+};
+// verify the running upload job
+static bool verify_uploads = false;
+// upload failed slots again
+static bool verify_requeue = false;
+// re-queued uploads so far
+static int verify_rounds = 0;
+// uploaded slots to read back
+static std::deque<verify_item> verify_queue;
+static std::vector<verify_item> verify_failed;
+static int verify_passed = 0;
+// slot we are reading back, -1 if none
+static int verify_slot = -1;
+static void verify_dump_arrived(const unsigned char* dump, int size);
+// true if a dump is the slot we read back (and not one somebody else asked for)
+static bool verify_dump(const unsigned char* dump)
+{
+	return verify_slot >= 0 && dump[7] + 128 * dump[8] == verify_slot;
+}
+static void start_verification(std::deque<verify_item>& uploaded);
+static void stop_verification();
+static void start_preset_upload(const std::string& job);
+
+// bulk downloads of slots >= 512 go through the edit buffer (program change, settle, dump)
+// matching dumps before the settle time of pipelined requests is halved
+#define HIGH_SLOT_MATCHES 16
+// slot we sent the program change for while the previous dump arrived, -1 if none
+static int high_slot_selected = -1;
+// settle time of pipelined requests in ms, -1 until the job starts
+static int high_slot_settle = -1;
+// dumps that matched their slot since the settle time changed
+static int high_slot_matches = 0;
+// false once pipelining caused mismatches at the full settle time
+static bool high_slot_pipelined = true;
+// the pending request sent its own program change and waits the full settle time
+static bool high_slot_full = false;
+// arp dump requests a bulk arp download keeps in flight
+#define ARP_WINDOW 2
+// bulk arp download in progress
+static bool downloading_arps = false;
+// arps requested but not received yet, oldest first
+static std::deque<int> arp_pending;
+// retries of the oldest arp request
+static unsigned char arp_retries = 0;
+// bulk arp upload in progress
+static bool uploading_arps = false;
+// arp we uploaded last, waiting for the device to send it back if >= 0
+static int arp_echo_slot = -1;
+// checksum of the arp file we uploaded last
+static unsigned int arp_echo_checksum = 0;
+
+void save_presets(void*);
+void load_preset_flash(void*);
+void save_arps(void*);
+void load_arp_flash(void*);
+static void arp_dump_arrived(int number);
+
+// statistics of the running transfer job
+static Transfer_Telemetry telemetry;
+// a single preset load or save is running (see PXK::Loading)
+static bool single_transfer = false;
+
+// refreshes the statistics in the progress window
+static void telemetry_update(void*)
+{
+	if (!telemetry.running())
+		return;
+	ui->init_stats->copy_label(telemetry.summary(ui->init_progress->value(), ui->init_progress->maximum()).c_str());
+	Fl::repeat_timeout(.5, telemetry_update);
+}
+
+static void telemetry_start(const char* job)
+{
+	single_transfer = false;
+	telemetry.start(job);
+	ui->init_stats->copy_label("");
+	Fl::remove_timeout(telemetry_update);
+	Fl::add_timeout(.5, telemetry_update);
+}
+
+static void telemetry_finish(bool completed)
+{
+	if (!telemetry.running())
+		return;
+	Fl::remove_timeout(telemetry_update);
+	bool single = single_transfer;
+	single_transfer = false;
+	telemetry.finish(completed);
+	if (single)
+		return;
+	std::string report = "\n" + Transfer_Telemetry::report(*telemetry.last()) + "\n";
+	ui->init_log->append(report.c_str());
+}
 
-void check_for_packet_ack(void*);
+// the single preset load or save finished
+static void single_transfer_done(void*)
+{
+	if (!single_transfer)
+		return;
+	telemetry.item_done(0);
+	telemetry_finish(true);
+}
 
 
 void PXK::widget_callback(int id, int value, int layer)
@@ -145,12 +279,9 @@ void PXK::widget_callback(int id, int value, int layer)
 		}
 		return;
 	}
-	// select editing layer
+	// select editing layer (the layer select is sent with the edit)
 	if (layer != selected_layer && layer != -2 && !ui->eall)
-	{
 		selected_layer = layer;
-		midi->edit_parameter_value(898, selected_layer);
-	}
 	// volume, honor mute state ")
 	if (id == 1410 && mute_volume[selected_layer] != -100)
 	{
@@ -163,10 +294,13 @@ void PXK::widget_callback(int id, int value, int layer)
 	{
 		if (ui->eall)
 		{
+			// one undo step for all layers
+			preset->begin_undo_group();
 			ret |= preset->set_value(id, value, 0);
 			ret |= preset->set_value(id, value, 1);
 			ret |= preset->set_value(id, value, 2);
 			ret |= preset->set_value(id, value, 3);
+			preset->end_undo_group();
 		}
 		else
 			ret = preset->set_value(id, value, selected_layer);
@@ -175,10 +309,25 @@ void PXK::widget_callback(int id, int value, int layer)
 		ret = setup->set_value(id, value, selected_channel);
 	// update changes remotely but only if we really changed something
 	if (ret == 1)
-		midi->edit_parameter_value(id, value);
+	{
+		if (id < 1409)
+			midi->queue_parameter_value(id, value);
+		else
+			midi->queue_parameter_value(id, value, ui->eall ? -1 : selected_layer);
+	}
 	else
 		return;
+	if (id > 898)
+		update_change_count();
+	update_dependencies(id, value, layer);
+}
 
+/**
+ * updates everything that depends on a parameter value after it has been changed
+ * locally. shared by the widget callback and undo/redo.
+ */
+void PXK::update_dependencies(int id, int value, int layer)
+{
 	// id's which have deps and need further updates below
 	switch (id)
 	{
@@ -255,6 +404,14 @@ void PXK::widget_callback(int id, int value, int layer)
 		((Fl_Slider*) ui->main->ctrl_x[(id > 922) ? id - 915 : id - 914])->value((double) value);
 }
 
+bool PXK::hold_muted_volume(int layer, int value)
+{
+	if (layer < 0 || layer > 3 || mute_volume[layer] == -100)
+		return false;
+	mute_volume[layer] = value;
+	return true;
+}
+
 void PXK::cc_callback(int controller, int value)
 {
 	//pmesg("PXK::cc_callback(%d, %d) \n", controller, value);
@@ -280,6 +437,7 @@ PXK::PXK()
 	roms = 0;
 	preset = 0;
 	preset_copy = 0;
+	changed_parameters = 0;
 	setup = 0;
 	setup_copy = 0;
 	setup_init = 0;
@@ -745,6 +903,9 @@ Club:
 		setups_to_load = -1;
 		requested = false;
 		ui->init->hide();
+		if (timed_out)
+			telemetry.timeout();
+		telemetry_finish(!timed_out && !join_bro);
 		ui->main_window->showup(); // make main active (important!)
 		if (timed_out)
 		{
@@ -796,6 +957,14 @@ bool PXK::Synchronize()
 		return false;
 	pmesg("PXK::Synchronize()\n");
 	display_status("Synchronizing...");
+	// use the delay we found for these ports
+	int delay = cfg->get_port_delay(port_key().c_str());
+	if (delay != -1 && delay != ui->speed->value())
+	{
+		cfg->set_cfg_option(CFG_SPEED, delay);
+		ui->speed->value(delay);
+		midi->edit_parameter_value(405, cfg->get_cfg_option(CFG_SPEED));
+	}
 #ifdef SYNCLOG
 	char buf[64];
 	snprintf(buf, 64, "PXK::Synchronize() %d[ms]\n\n", cfg->get_cfg_option(CFG_SPEED));
@@ -804,6 +973,7 @@ bool PXK::Synchronize()
 	midi->filter_strict(); // filter everything but sysex for sync
 	init_progress = 0;
 	name_set_incomplete = false;
+	telemetry_start("Synchronize");
 	Fl::add_timeout(0, sync_bro, (void*) &synchronized);
 	return true;
 }
@@ -816,41 +986,19 @@ bool PXK::Synchronized() const
 void PXK::log_add(const unsigned char* sysex, const unsigned int len, unsigned char io) const
 {
 	//pmesg("PXK::log_add(sysex, %d, %d)\n", len, io);
-	bool log = false;
-	char* buf = 0;
-	if ((io == 1 && cfg->get_cfg_option(CFG_LOG_SYSEX_IN)) || (io == 0 && cfg->get_cfg_option(CFG_LOG_SYSEX_OUT)))
-	{
-		log = true;
-		buf = new char[2 * len + 18];
-	}
-	unsigned char n = 0;
-	if (log)
-	{
-		if (io == 1)
-		{
-			static unsigned int count_i = 0;
-			n = snprintf(buf, 16, "\nI.%u::", ++count_i);
-		}
-		else
-		{
-			static unsigned int count_o = 0;
-			n = snprintf(buf, 16, "\nO.%u::", ++count_o);
-		}
-	}
-	for (unsigned int i = 0; i < len; i++)
-	{
-		if (log)
-			sprintf(n + buf + 2 * i, "%02hhX", sysex[i]);
-		if (io == 1)
-			ui->scope_i->Add(sysex[i]);
-		else
-			ui->scope_o->Add(sysex[i]);
-	}
-	if (buf)
-	{
-		ui->logbuf->append(buf);
-		delete[] buf;
-	}
+	if (io == 1)
+		telemetry.received(len);
+	else
+		telemetry.sent(len);
+	// raw bytes, the log window renders the text
+	if (io == 1 && cfg->get_cfg_option(CFG_LOG_SYSEX_IN))
+		ui->logbuf->add(LOG_SYSEX_IN, sysex, len);
+	else if (io == 0 && cfg->get_cfg_option(CFG_LOG_SYSEX_OUT))
+		ui->logbuf->add(LOG_SYSEX_OUT, sysex, len);
+	if (io == 1)
+		ui->scope_i->Add(sysex, len);
+	else
+		ui->scope_o->Add(sysex, len);
 }
 
 /* if autoconnection is enabled but the device is not powered
@@ -1105,7 +1253,10 @@ void PXK::incoming_preset_dump(const unsigned char* data, int len, bool restart)
 			unsigned char checksum = ~sum;
 			// compare checksums
 			if (checksum % 128 != data[len - 2])
+			{
 				midi->nak(data[8] * 128 + data[7]);
+				transfer_error();
+			}
 			else
 			{
 				midi->ack(data[8] * 128 + data[7]);
@@ -1113,6 +1264,12 @@ void PXK::incoming_preset_dump(const unsigned char* data, int len, bool restart)
 				dump_pos += len;
 				if (len < 253) // last packet
 				{
+					if (verify_dump(dump))
+					{
+						verify_dump_arrived(dump, dump_pos);
+						dump_pos = 0;
+						return;
+					}
 					delete preset;
 					if (randomizing)
 					{
@@ -1138,6 +1295,12 @@ void PXK::incoming_preset_dump(const unsigned char* data, int len, bool restart)
 			dump_pos += len;
 			if (len < 253) // last packet
 			{
+				if (verify_dump(dump))
+				{
+					verify_dump_arrived(dump, dump_pos);
+					dump_pos = 0;
+					return;
+				}
 				delete preset;
 				if (randomizing)
 				{
@@ -1193,6 +1356,13 @@ void PXK::incoming_setup_dump(const unsigned char* data, int len)
 
 static void check_loading(void*)
 {
+	if (single_transfer)
+	{
+		if (!got_answer)
+			telemetry.timeout();
+		telemetry.item_done(0);
+		telemetry_finish(got_answer);
+	}
 	if (!got_answer)
 	{
 		fl_alert("Device did not respond to our request.");
@@ -1206,6 +1376,13 @@ void PXK::Loading(bool upload)
 	Fl::remove_timeout(check_loading);
 	ui->supergroup->set_output();
 	got_answer = false;
+	// bulk jobs have their own statistics
+	if (!telemetry.running())
+	{
+		telemetry_start(upload ? "Preset save" : "Preset load");
+		telemetry.item_started(0);
+		single_transfer = true;
+	}
 	if (upload)
 	{
 		display_status("Saving program...");
@@ -1215,6 +1392,8 @@ void PXK::Loading(bool upload)
 		{
 			got_answer = true;
 			Fl::add_timeout(2.5, check_loading);
+			// the dump is written right after this
+			Fl::add_timeout(0, single_transfer_done);
 		}
 	}
 	else
@@ -1245,6 +1424,8 @@ void PXK::load_setup()
 {
 	pmesg("PXK::load_setup() \n");
 	display_status("Loading multisetup...");
+	// name lists may have changed, the next preset refreshes all widgets
+	Preset_Dump::invalidate_shown();
 	if (setup_init)
 	{
 		setup = setup_init->Clone();
@@ -1324,6 +1505,7 @@ void PXK::incoming_generic_name(const unsigned char* data)
 	else if (0 == rom[get_rom_index(rom_id)]->set_name(type, number, data + 11))
 		name_set_incomplete = false;
 	++init_progress;
+	telemetry.item_done();
 }
 
 void PXK::incoming_arp_dump(const unsigned char* data, int len)
@@ -1364,16 +1546,25 @@ void PXK::incoming_arp_dump(const unsigned char* data, int len)
 		{
 			rom[get_rom_index(rom_id)]->set_name(ARP, number, data + 14);
 			++init_progress;
+			telemetry.item_done();
 		}
 	}
 	else // this is a dump we like to edit ")
 	{
 		delete arp;
 		arp = new Arp_Dump(len, data, !started_request);
-		display_status("Arp pattern loaded.");
+		if (downloading_arps || uploading_arps)
+			arp_dump_arrived(data[6] + 128 * data[7]);
+		else
+			display_status("Arp pattern loaded.");
 	}
 }
 
+bool PXK::arp_transfer_pending() const
+{
+	return (downloading_arps && !arp_pending.empty()) || (uploading_arps && arp_echo_slot >= 0);
+}
+
 
 void PXK::incoming_ACK(int packet)
 {
@@ -1384,6 +1575,11 @@ void PXK::incoming_ACK(int packet)
 		preset->upload(++packet);
 
 		ack_count++;
+		// EOF has been sent
+		if (uploading_presets && preset_transfer_complete())
+			preset_upload_complete();
+		else if (single_transfer && preset_transfer_complete())
+			single_transfer_done(0);
 
 #ifdef SYNCLOG
 		char buf[128];
@@ -1399,18 +1595,269 @@ void PXK::incoming_NAK(int packet)
 {
 	pmesg("PD:incoming_NAK:(packet: %d) \n", packet);
 	display_status("Received NAK. Retrying...");
+	transfer_error();
 	if (preset && nak_count < 3)
 	{
+		telemetry.retry();
 		preset->upload(packet);
 		++nak_count;
 	}
 	else
 	{
-		Fl::remove_timeout(check_for_packet_ack);
+		Fl::remove_timeout(load_preset_flash);
+		if (uploading_presets)
+		{
+			// keep the journal and close the job down
+			journal.fail();
+			telemetry_finish(false);
+			reset();
+		}
 		fl_message("Closed Loop Upload failed!");
 	}
 }
 
+// sysex delay calibration
+// names requested per trial (the edit buffer dump is the last reply)
+#define CAL_NAMES 8
+// trials per delay setting
+#define CAL_ROUNDS 2
+// highest CFG_SPEED setting
+#define CAL_SLOWEST 4
+static struct
+{
+	bool running;
+	bool downward;
+	int level;
+	int reliable;
+	int previous;
+	int round;
+	bool have_reference;
+	unsigned int reference[CAL_NAMES + 1];
+	unsigned int reply[CAL_NAMES + 1];
+	bool got[CAL_NAMES + 1];
+	unsigned char dump[1615];
+	int dump_pos;
+	bool dump_error;
+} cal;
+// transfer errors since the last calibration and when the first of them happened
+static int transfer_errors = 0;
+static time_t first_transfer_error = 0;
+
+static void calibration_evaluate(void*);
+static void revalidate_delay(void*);
+
+static void calibration_trial()
+{
+	for (int i = 0; i <= CAL_NAMES; i++)
+		cal.got[i] = false;
+	cal.dump_pos = 0;
+	cal.dump_error = false;
+	cfg->set_cfg_option(CFG_SPEED, cal.level);
+	midi->edit_parameter_value(405, cfg->get_cfg_option(CFG_SPEED));
+	for (int i = 0; i < CAL_NAMES; i++)
+		midi->request_name(PRESET, i, 0);
+	midi->request_edit_buffer_dump();
+	Fl::add_timeout((1500. + 8 * cfg->get_cfg_option(CFG_SPEED) + 50 * CAL_NAMES) / 1000., calibration_evaluate);
+}
+
+static void calibration_finish()
+{
+	cal.running = false;
+	int level = cal.reliable != -1 ? cal.reliable : cal.previous;
+	cfg->set_cfg_option(CFG_SPEED, level);
+	midi->edit_parameter_value(405, cfg->get_cfg_option(CFG_SPEED));
+	ui->speed->value(level);
+	transfer_errors = 0;
+	char buf[64];
+	if (cal.reliable != -1)
+	{
+		cfg->set_port_delay(pxk->port_key().c_str(), level);
+		snprintf(buf, 64, "Sysex delay calibrated: %d ms", cfg->get_cfg_option(CFG_SPEED));
+	}
+	else
+		snprintf(buf, 64, "*** Sysex delay calibration failed.");
+	pxk->display_status(buf);
+}
+
+static void calibration_evaluate(void*)
+{
+	Fl::remove_timeout(calibration_evaluate);
+	if (!cal.running)
+		return;
+	bool ok = !cal.dump_error;
+	for (int i = 0; ok && i <= CAL_NAMES; i++)
+		ok = cal.got[i] && (!cal.have_reference || cal.reply[i] == cal.reference[i]);
+	if (ok && !cal.have_reference)
+	{
+		for (int i = 0; i <= CAL_NAMES; i++)
+			cal.reference[i] = cal.reply[i];
+		cal.have_reference = true;
+	}
+	if (ok && ++cal.round < CAL_ROUNDS)
+	{
+		calibration_trial();
+		return;
+	}
+	cal.round = 0;
+	if (cal.downward)
+	{
+		// keep the replies of the slowest setting as reference
+		if (!ok || cal.level == 0)
+		{
+			if (ok)
+				cal.reliable = 0;
+			calibration_finish();
+			return;
+		}
+		cal.reliable = cal.level--;
+	}
+	else
+	{
+		// compare the rounds of each setting
+		cal.have_reference = false;
+		if (ok || cal.level == CAL_SLOWEST)
+		{
+			if (ok)
+				cal.reliable = cal.level;
+			calibration_finish();
+			return;
+		}
+		++cal.level;
+	}
+	calibration_trial();
+}
+
+void PXK::calibrate_delay(bool revalidate)
+{
+	pmesg("PXK::calibrate_delay(%d) \n", revalidate);
+	if (cal.running || ui->init->shown() || !midi->out())
+		return;
+	// the replies of a pending request would end up in the calibration
+	if (midi->request_pending() || started_request)
+	{
+		if (revalidate)
+			Fl::add_timeout(1., revalidate_delay);
+		else
+			display_status("*** Device busy, try again later.");
+		return;
+	}
+	display_status(revalidate ? "Re-validating sysex delay..." : "Calibrating sysex delay...");
+	cal.running = true;
+	cal.downward = !revalidate;
+	cal.previous = ui->speed->value();
+	cal.level = revalidate ? cal.previous : CAL_SLOWEST;
+	cal.reliable = -1;
+	cal.round = 0;
+	cal.have_reference = false;
+	calibration_trial();
+}
+
+bool PXK::calibrating() const
+{
+	return cal.running;
+}
+
+void PXK::incoming_calibration(const unsigned char* sysex, int len)
+{
+	if (sysex[5] == 0x0b)
+	{
+		int number = sysex[7] + 128 * sysex[8];
+		if (number < CAL_NAMES)
+		{
+			cal.reply[number] = bank_checksum(sysex, len);
+			cal.got[number] = true;
+		}
+	}
+	else if (sysex[6] == 0x03) // open loop header
+	{
+		memcpy(cal.dump, sysex, len);
+		cal.dump_pos = len;
+	}
+	else if (sysex[6] == 0x04 && cal.dump_pos && cal.dump_pos + len <= 1615)
+	{
+		int sum = 0;
+		for (int i = 9; i < len - 2; i++)
+			sum += sysex[i];
+		unsigned char checksum = ~sum;
+		if (checksum % 128 != sysex[len - 2])
+			cal.dump_error = true;
+		memcpy(cal.dump + cal.dump_pos, sysex, len);
+		cal.dump_pos += len;
+		if (len < 253) // last packet
+		{
+			cal.reply[CAL_NAMES] = bank_checksum(cal.dump, cal.dump_pos);
+			cal.got[CAL_NAMES] = true;
+		}
+	}
+	// don't wait for the timeout if we have everything
+	for (int i = 0; i <= CAL_NAMES; i++)
+		if (!cal.got[i])
+			return;
+	Fl::remove_timeout(calibration_evaluate);
+	Fl::add_timeout(0, calibration_evaluate);
+}
+
+// re-validates the sysex delay once the device is idle
+static void revalidate_delay(void*)
+{
+	if (ui->init->shown() || pxk->save_in_progress || pxk->started_request || midi->request_pending())
+	{
+		Fl::repeat_timeout(1., revalidate_delay);
+		return;
+	}
+	pxk->calibrate_delay(true);
+}
+
+void PXK::transfer_error()
+{
+	time_t now = time(0);
+	if (transfer_errors == 0 || now - first_transfer_error > 60)
+	{
+		transfer_errors = 0;
+		first_transfer_error = now;
+	}
+	if (++transfer_errors < 3)
+		return;
+	transfer_errors = 0;
+	// go one step slower right away, check it when the transfer is done
+	int level = ui->speed->value();
+	if (level < CAL_SLOWEST)
+	{
+		ui->speed->value(level + 1);
+		cfg->set_cfg_option(CFG_SPEED, level + 1);
+		midi->edit_parameter_value(405, cfg->get_cfg_option(CFG_SPEED));
+		cfg->set_port_delay(port_key().c_str(), level + 1);
+	}
+	Fl::add_timeout(1., revalidate_delay);
+}
+
+std::string PXK::port_key() const
+{
+	std::string key(ui->midi_outs->label() ? ui->midi_outs->label() : "");
+	key += " > ";
+	key += ui->midi_ins->label() ? ui->midi_ins->label() : "";
+	return key;
+}
+
+std::string PXK::device_key() const
+{
+	return port_key() + " " + device_identity();
+}
+
+std::string PXK::device_identity() const
+{
+	char buf[32];
+	snprintf(buf, 32, "#%d %d", device_id, device_code);
+	std::string id(buf);
+	for (int i = 0; i < 5; i++)
+		if (rom[i])
+		{
+			snprintf(buf, 32, " %d", rom[i]->get_romid());
+			id += buf;
+		}
+	return id;
+}
+
 //void PXK::incoming_ERROR(int cmd, int sub)
 //{
 //	pmesg("PXK::incoming_ERROR(cmd: %X, subcmd: %X) \n", cmd, sub);
@@ -1637,13 +2084,13 @@ void PXK::load_export(const char* filename)
 		file.close();
 		return;
 	}
-	unsigned char* sysex = new unsigned char[size];
+	unsigned char* sysex = dump_buffer_alloc(size);
 	file.read((char*) sysex, size);
 	file.close();
 	if (!(sysex[0] == 0xf0 && sysex[1] == 0x18 && sysex[2] == 0x0f && sysex[4] == 0x55 && sysex[size - 1] == 0xf7))
 	{
 		display_status("*** File format unsupported.");
-		delete[] sysex;
+		dump_buffer_free(sysex, size);
 		return;
 	}
 	// find packet size
@@ -1653,7 +2100,7 @@ void PXK::load_export(const char* filename)
 			break;
 	if (0 != test_checksum(sysex, size, pos - DUMP_HEADER_SIZE + 1))
 	{
-		delete[] sysex;
+		dump_buffer_free(sysex, size);
 		display_status("File failed checksum test.");
 		return;
 	}
@@ -1672,7 +2119,7 @@ void PXK::load_export(const char* filename)
 	preset->move(-1);
 	preset->upload(0, cfg->get_cfg_option(CFG_CLOSED_LOOP_UPLOAD));
 	show_preset();
-	delete[] sysex;
+	dump_buffer_free(sysex, size);
 }
 
 
@@ -1813,6 +2260,14 @@ void PXK::display_status(const char* message)
 	ui->status->copy_label(message);
 }
 
+void PXK::update_change_count()
+{
+	if (!preset || !preset_copy)
+		return;
+	changed_parameters = preset->diff(preset_copy);
+	preset->show_name(changed_parameters);
+}
+
 void PXK::update_fx_values(int id, int value) const
 {
 	//pmesg("PXK::update_fx_values(%d, %d) \n", id, value);
@@ -2308,13 +2763,15 @@ void PXK::store_play_as_initial()
 	widget_callback(925, (int) ((Fl_Slider*) ui->main->ctrl_x[10])->value());
 	widget_callback(926, (int) ((Fl_Slider*) ui->main->ctrl_x[11])->value());
 	widget_callback(927, (int) ((Fl_Slider*) ui->main->ctrl_x[12])->value());
-	for (int i = 915; i < 928; i++)
-		if (pwid[i][0] && i != 923)
-			pwid[i][0]->set_value(preset->get_value(i));
+	const std::vector<pwid_entry>& params = pwid_registry.group(PWID_PRESET);
+	for (size_t i = 0; i < params.size() && params[i].id < 928; i++)
+		if (params[i].id != 923)
+			params[i].widget->set_value(preset->get_value(params[i].id));
 }
 
 void PXK::reset()
 {
+	telemetry_finish(!pending_cancel); // statistics of the job
 	ui->init->hide();          // close progress bar
 	got_answer = true;
 	moar_files = false;
@@ -2322,6 +2779,21 @@ void PXK::reset()
 	save_in_progress = false;  // closed loop dumps in progress
 	started_request = false;   // one preset of the dumps is in progress
 	pending_cancel = false;    // cancel flag
+	downloading_presets = false; // bulk preset download
+	uploading_presets = false; // bulk preset upload
+	settling_slot = -1;
+	stop_verification();       // read-back of the last upload
+	high_slot_selected = -1;   // pipelined edit buffer downloads
+	high_slot_settle = -1;
+	high_slot_matches = 0;
+	high_slot_pipelined = true;
+	downloading_arps = false;  // bulk arp download
+	arp_pending.clear();
+	uploading_arps = false;    // bulk arp upload
+	arp_echo_slot = -1;
+	prefetcher.stop();         // bulk import file reader
+	bank.close();              // bulk export archive
+	journal.close();           // keep the journal of an interrupted job
 	join_bro = false;          // midi input process routine reset
 	midi->reset_handler();     // midi request flag 
 	midi->ack(0);              // send any command to clear instrument state (device will cancel/ignore)
@@ -2346,209 +2818,666 @@ void cb_pres_validate(Fl_Widget* w, void* args)
 	((Fl_Spinner*)w->parent()->child(4))->value((num_pres - 1) % 128);
 }
 
+// opens the journal of a bulk job and asks whether an interrupted run of it should be resumed
+static void open_journal(const std::string& filename, const std::string& job)
+{
+	if (!journal.open(filename, pxk->device_key() + "\n" + job))
+		return;
+	int done = (int) journal.resumable();
+	if (done && fl_choice("An interrupted run of this job completed %d item(s).\n"
+		"Resume and skip them?", "Start over", "Resume", 0, done) != 1)
+		journal.restart();
+}
+
+// logs a slot that is skipped because an interrupted run of the job already did it
+static void log_skipped(int type, int slot)
+{
+	char buf[64];
+	snprintf(buf, 64, "skipping:  %s %d (journaled)\n", type == ARP ? "arp" : "preset", slot);
+	ui->init_log->append(buf);
+}
+
+// job signature of an import: files and the first slot
+static std::string import_job(const char* what, int offset, const std::vector<std::string>& files)
+{
+	char buf[64];
+	snprintf(buf, 64, "%s upload to %d", what, offset);
+	std::string job(buf);
+	for (size_t i = 0; i < files.size(); i++)
+		job += "\n" + files[i];
+	return job;
+}
+
+// job signature of an export: rom, slots and target
+static std::string export_job(const char* what, const std::vector<int>& slots, bool archive)
+{
+	char buf[96];
+	snprintf(buf, 96, "%s download rom %d slots %d-%d%s", what, pxk->preset_dump_rom, slots.empty() ? 0 : slots.front(),
+		slots.empty() ? 0 : slots.back(), archive ? " archive" : "");
+	return buf;
+}
+
 void load_preset_flash(void*)
 {
-	if (pxk->preset_list.empty() || pxk->pending_cancel)
+	Fl::remove_timeout(load_preset_flash);
+	// the device didn't answer after the last preset
+	if (settling_slot >= 0)
+	{
+		telemetry.timeout();
+		journal.fail();
+	}
+	settling_slot = -1;
+	prefetched_file f;
+	if (pxk->pending_cancel || !prefetcher.next(&f))
 	{
+		bool verify = verify_uploads && !pxk->pending_cancel;
+		std::deque<verify_item> uploaded;
+		uploaded.swap(verify_queue);
+		if (!pxk->pending_cancel)
+			journal.finish();
 		pxk->reset();
+		if (verify)
+			start_verification(uploaded);
 		return;
 	}
 
-	if (pxk->preset_list.size() > 1)
-		moar_files = true;
-	else
-		moar_files = false;
-
 	// gets next file
-	std::string filename = pxk->preset_list.front();
-	pxk->preset_list.erase(pxk->preset_list.begin());
+	if (!pxk->preset_list.empty())
+		pxk->preset_list.erase(pxk->preset_list.begin());
+	moar_files = prefetcher.remaining() > 0;
 
 	int is_closed = cfg->get_cfg_option(CFG_CLOSED_LOOP_UPLOAD);
 
-#ifdef __linux
-	int offset = 0;
-	while (strncmp(filename.c_str() + offset, "/", 1) != 0)
-		++offset;
-	char n[PATH_MAX];
-	snprintf(n, PATH_MAX, "%s", filename.c_str() + offset);
-	while (n[strlen(n) - 1] == '\n' || n[strlen(n) - 1] == '\r' || n[strlen(n) - 1] == ' ')
-		n[strlen(n) - 1] = '\0';
-	std::ifstream file(n, std::ifstream::binary);
-#else
-	std::ifstream file(filename, std::ifstream::binary);
-#endif
-
-	// check and load file
-	int size;
-	file.seekg(0, std::ios::end);
-	size = file.tellg();
-	file.seekg(0, std::ios::beg);
-	if (size < 1605 || size > 1615)
+	if (!f.sysex)
 	{
-		pxk->display_status("File size incorrect");
-		file.close();
+		pxk->display_status(f.error);
+		journal.fail();
+		// skip it
+		Fl::add_timeout(0, load_preset_flash);
 		return;
 	}
-	unsigned char* sysex = new unsigned char[size];
-	file.read((char*)sysex, size);
-	file.close();
-	if (!(sysex[0] == 0xf0 && sysex[1] == 0x18 && sysex[2] == 0x0f && sysex[4] == 0x55 && sysex[5] == 0x10 && sysex[size - 1] == 0xf7))
+
+	unsigned int checksum = bank_checksum(f.sysex, f.size);
+	int pres_id;
+	if (upload_slots.empty())
+		pres_id = pxk->get_preset_and_increment();
+	else
 	{
-		pxk->display_status("Sysex is not a preset");
-		delete[] sysex;
-		return;
+		pres_id = upload_slots.front();
+		upload_slots.pop_front();
 	}
-	// find packet size
-	int pos = DUMP_HEADER_SIZE; // start after the header
-	while (++pos < size) // calculate packet size
-		if (sysex[pos] == 0xf7)
-			break;
 
-	pxk->new_preset(size, sysex, pos - DUMP_HEADER_SIZE + 1);
+	// skip what an interrupted run of this job already uploaded
+	const journal_entry* done = journal.find(PRESET, 0, pres_id);
+	if (done && done->checksum == checksum)
+	{
+		log_skipped(PRESET, pres_id);
+		// still verify it, the device may have changed since
+		if (verify_uploads)
+		{
+			pxk->new_preset(f.size, f.sysex, f.packet_size);
+			pxk->preset->move(pres_id);
+			verify_item v;
+			v.slot = pres_id;
+			v.checksum = pxk->preset->normalized_checksum();
+			v.file = f.filename;
+			verify_queue.push_back(v);
+		}
+		prefetcher.release(&f);
+		ui->init_progress->value((float)++init_progress);
+		Fl::add_timeout(0, load_preset_flash);
+		return;
+	}
 
-	int pres_id = pxk->get_preset_and_increment();
+	pxk->new_preset(f.size, f.sysex, f.packet_size);
 	pxk->clear_preset_handler();
 	pxk->preset->move(pres_id);
+	uploading_presets = true;
+	settling_slot = pres_id;
+	settling_checksum = checksum;
+	telemetry.item_started(pres_id);
+	if (verify_uploads)
+	{
+		verify_item v;
+		v.slot = pres_id;
+		v.checksum = pxk->preset->normalized_checksum();
+		v.file = f.filename;
+		verify_queue.push_back(v);
+	}
 	pxk->preset->upload(0, is_closed);
 
-	delete[] sysex;
-
+	prefetcher.release(&f);
 
 	ui->init_progress->value((float)++init_progress);
 
-	if (moar_files == true)
-	{
-		if (is_closed)
-		{
-			Fl::add_timeout(0.1, check_for_packet_ack);
-		}
-		else
-		{
-			Fl::add_timeout((50. + cfg->get_cfg_option(CFG_SPEED))/1000., load_preset_flash, NULL);
-		}
-	}
+	// closed loop continues with the last ACK (PXK::incoming_ACK)
+	if (!is_closed)
+		pxk->preset_upload_complete();
+}
+
+void PXK::preset_upload_complete()
+{
+	if (settling_slot < 0)
+		return;
+	// the device answers once it processed the dump (and everything before it)
+	midi->request_name(PRESET, settling_slot, 0);
+	// don't wait forever if it doesn't
+	if (cfg->get_cfg_option(CFG_CLOSED_LOOP_UPLOAD))
+		Fl::add_timeout((1000. + cfg->get_cfg_option(CFG_SPEED)) / 1000., load_preset_flash);
 	else
-	{
-		ui->init->hide();
-	}
+		Fl::add_timeout((1500. + 8 * cfg->get_cfg_option(CFG_SPEED)) / 1000., load_preset_flash);
+}
 
-	return;
+void PXK::preset_upload_settled()
+{
+	if (!uploading_presets || settling_slot < 0)
+		return;
+	// the device has it
+	journal.add(PRESET, 0, settling_slot, settling_checksum);
+	telemetry.item_done(settling_slot);
+	settling_slot = -1;
+	Fl::remove_timeout(load_preset_flash);
+	Fl::add_timeout(0, load_preset_flash);
 }
 
-void check_for_packet_ack(void*)
+// read-back verification. runs in the background when the device is idle
+// and compares every uploaded slot with its source (see preset_dump_checksum)
+static void verify_next(void*);
+
+static void verify_timeout(void*)
+{
+	// the dump didn't arrive
+	midi->reset_handler();
+	verify_dump_arrived(0, 0);
+}
+
+static void start_verification(std::deque<verify_item>& uploaded)
+{
+	stop_verification();
+	verify_queue.swap(uploaded);
+	verify_failed.clear();
+	verify_passed = 0;
+	if (verify_queue.empty())
+		return;
+	ui->init_log->append("\nVerifying uploaded presets...\n");
+	pxk->display_status("Verifying uploaded presets...");
+	// give the device time to crunch
+	Fl::add_timeout(2., verify_next);
+}
+
+static void stop_verification()
+{
+	Fl::remove_timeout(verify_next);
+	Fl::remove_timeout(verify_timeout);
+	if (verify_slot >= 0 || !verify_queue.empty())
+		ui->init_log->append("*** Upload verification interrupted.\n");
+	verify_queue.clear();
+	verify_slot = -1;
+}
+
+static void verify_report()
 {
-#ifdef SYNCLOG
 	char buf[128];
-	sprintf(buf, "calling:  check_for_packet_ack \n");
+	snprintf(buf, 128, "Upload verification: %d passed, %d failed.", verify_passed, (int) verify_failed.size());
 	ui->init_log->append(buf);
-#endif
-
-	if (pxk->preset_transfer_complete() || pxk->pending_cancel)
+	ui->init_log->append("\n");
+	pxk->display_status(buf);
+	if (verify_failed.empty() || !verify_requeue || verify_rounds >= VERIFY_ROUNDS)
 	{
-		Fl::remove_timeout(check_for_packet_ack);
-
-		if (moar_files)
-		{
-			Fl::add_timeout(1.0, load_preset_flash, NULL);
-		}
+		if (!verify_failed.empty())
+			fl_message("%s\nSee the sync log for the failed slots.", buf);
+		return;
 	}
-	else
+	// upload the failed slots again (and verify them)
+	++verify_rounds;
+	pxk->preset_list.clear();
+	upload_slots.clear();
+	for (size_t i = 0; i < verify_failed.size(); i++)
 	{
-		Fl::repeat_timeout(0.1, check_for_packet_ack);
+		pxk->preset_list.push_back(verify_failed[i].file);
+		upload_slots.push_back(verify_failed[i].slot);
 	}
+	verify_failed.clear();
+	start_preset_upload("");
 }
 
-void save_presets(void*)
+static void verify_next(void*)
 {
-	if (pxk->pending_cancel)
+	// low priority: wait until nothing else talks to the device
+	if (ui->init->shown() || pxk->started_request || pxk->calibrating() || midi->request_pending())
 	{
-		pxk->reset();
+		Fl::repeat_timeout(.5, verify_next);
 		return;
 	}
-
-	if (!pxk->save_in_progress)
+	if (verify_queue.empty())
 	{
-		if (pxk->started_request)
-		{
-			pxk->preset->save_file(pxk->output_dir.c_str(), pxk->selected_preset);
-
-			if (pxk->preset_saves.empty())
-			{
-				pxk->reset();
-				return;
-			}
+		verify_report();
+		return;
+	}
+	verify_slot = verify_queue.front().slot;
+	midi->request_slot_dump(verify_slot, 0);
+	Fl::add_timeout((3000. + cfg->get_cfg_option(CFG_SPEED)) / 1000., verify_timeout);
+}
+
+// a slot we read back arrived (0 if it didn't)
+static void verify_dump_arrived(const unsigned char* dump, int size)
+{
+	Fl::remove_timeout(verify_timeout);
+	if (verify_queue.empty())
+	{
+		verify_slot = -1;
+		return;
+	}
+	verify_item item = verify_queue.front();
+	verify_queue.pop_front();
+	verify_slot = -1;
+	bool pass = dump && preset_dump_checksum(dump, size) == item.checksum;
+	char buf[PATH_MAX + 64];
+	snprintf(buf, PATH_MAX + 64, "%s preset %d: %s\n", pass ? "passed" : "*** FAILED", item.slot,
+			dump ? item.file.c_str() : "no answer");
+	ui->init_log->append(buf);
+	if (pass)
+		++verify_passed;
+	else
+		verify_failed.push_back(item);
+	// low priority, leave some room for everything else
+	Fl::add_timeout(.25 + cfg->get_cfg_option(CFG_SPEED) / 1000., verify_next);
+}
+
+// a dump could not be stored in the bank archive: the export can't go on
+static void bank_export_failed()
+{
+	char buf[PATH_MAX + 96];
+	snprintf(buf, PATH_MAX + 96, "*** Bank archive %s: %s. Export stopped.\n", bank.filename().c_str(), bank.last_error());
+	ui->init_log->append(buf);
+	journal.fail();
+	pxk->pending_cancel = true; // telemetry: not completed
+	pxk->reset();
+	fl_message("%s", buf + 4);
+}
+
+// true if an interrupted run of the export job already saved this dump (and it is still there)
+static bool export_done(int type, int slot)
+{
+	const journal_entry* e = journal.find(type, pxk->preset_dump_rom, slot);
+	if (!e)
+		return false;
+	if (bank.is_open())
+	{
+		int i = bank.find(type, pxk->preset_dump_rom, slot);
+		return i != -1 && bank.entry(i)->checksum == e->checksum && bank.dump(i);
+	}
+	unsigned int checksum;
+	return file_checksum(e->file, &checksum) && checksum == e->checksum;
+}
+
+// journals a saved dump with the checksum of what ended up on disk
+static void journal_export(int type, int slot, const std::string& saved = "")
+{
+	if (bank.is_open())
+	{
+		int i = bank.find(type, pxk->preset_dump_rom, slot);
+		if (i != -1 && bank.dump(i))
+		{
+			journal.add(type, pxk->preset_dump_rom, slot, bank.entry(i)->checksum);
+			return;
 		}
+	}
+	else
+	{
+		unsigned int checksum;
+		if (!saved.empty() && file_checksum(saved, &checksum))
+		{
+			journal.add(type, pxk->preset_dump_rom, slot, checksum, saved);
+			return;
+		}
+	}
+	journal.fail();
+}
 
-		pxk->selected_preset = pxk->preset_saves.front();
-		pxk->preset_saves.erase(pxk->preset_saves.begin());
-		pxk->selected_preset_rom = pxk->preset_dump_rom;
+// selects a slot >= 512 (these are only available through the edit buffer)
+static void high_slot_program_change(int slot)
+{
+	midi->write_event(0xb0, 0, pxk->preset_dump_rom, pxk->selected_channel);
+	midi->write_event(0xb0, 32, slot / 128, pxk->selected_channel);
+	midi->write_event(0xc0, slot % 128, 0, pxk->selected_channel);
+}
 
-		midi->write_event(0xb0, 0, pxk->selected_preset_rom, pxk->selected_channel);
-		midi->write_event(0xb0, 32, pxk->selected_preset / 128, pxk->selected_channel);
-		midi->write_event(0xc0, pxk->selected_preset % 128, 0, pxk->selected_channel);
+// name of a slot in the synced name list or 0
+static const unsigned char* high_slot_name(int slot)
+{
+	unsigned char r = pxk->get_rom_index(pxk->preset_dump_rom);
+	if (r == 5 || !pxk->rom[r])
+		return 0;
+	return pxk->rom[r]->get_name(PRESET, slot);
+}
 
-		if (cfg->get_cfg_option(CFG_CLOSED_LOOP_DOWNLOAD))
+// the last packet of a high slot dump arrived: the device is done with the
+// edit buffer, so the next slot can be selected while we save this one
+static void high_slot_select_next()
+{
+	high_slot_selected = -1;
+	if (!high_slot_pipelined || pxk->preset_saves.empty())
+		return;
+	int next = pxk->preset_saves.front();
+	if (next < 512)
+		return;
+	// a stale edit buffer would pass the identity check
+	const unsigned char* a = high_slot_name(pxk->selected_preset);
+	const unsigned char* b = high_slot_name(next);
+	if (!a || !b || memcmp(a, b, 16) == 0)
+		return;
+	high_slot_program_change(next);
+	high_slot_selected = next;
+}
+
+// checks that a high slot dump is the preset we asked for and adapts the pipeline
+static bool high_slot_confirmed()
+{
+	const unsigned char* expected = high_slot_name(pxk->selected_preset);
+	if (!expected || memcmp(pxk->preset->get_name_bytes(), expected, 16) == 0)
+	{
+		// the device keeps up, shorten the settle time
+		if (++high_slot_matches >= HIGH_SLOT_MATCHES && high_slot_settle > 0)
 		{
-			midi->request_preset_dump(100);
-			Fl::add_timeout(0.4, save_presets, NULL);
+			high_slot_settle /= 2;
+			high_slot_matches = 0;
 		}
+		return true;
+	}
+	char buf[80];
+	// a full settle after its own program change can't be stale, the name changed on the device
+	if (high_slot_full)
+	{
+		snprintf(buf, 80, "Preset %d: name differs from the synced name list.\n", pxk->selected_preset);
+		ui->init_log->append(buf);
+		return true;
+	}
+	snprintf(buf, 80, "*** Preset %d: the edit buffer held another preset.\n", pxk->selected_preset);
+	ui->init_log->append(buf);
+	// back off
+	int full = 50 + cfg->get_cfg_option(CFG_SPEED);
+	if (high_slot_settle >= full)
+		high_slot_pipelined = false;
+	else
+		high_slot_settle = high_slot_settle < 5 ? 10 : 2 * high_slot_settle;
+	if (high_slot_settle > full)
+		high_slot_settle = full;
+	high_slot_matches = 0;
+	high_slot_selected = -1;
+	return false;
+}
+
+// request the dump of pxk->selected_preset and arm the watchdog
+static void request_bulk_preset()
+{
+	pxk->selected_preset_rom = pxk->preset_dump_rom;
+	if (pxk->selected_preset >= 512)
+	{
+		int full = 50 + cfg->get_cfg_option(CFG_SPEED);
+		if (high_slot_settle == -1)
+			high_slot_settle = full / 2;
+		// the program change went out with the end of the previous dump
+		high_slot_full = high_slot_selected != pxk->selected_preset;
+		if (!high_slot_full)
+			midi->request_preset_dump(high_slot_settle);
 		else
 		{
-			midi->request_preset_dump(50 + cfg->get_cfg_option(CFG_SPEED));
-			Fl::add_timeout((50. + cfg->get_cfg_option(CFG_SPEED))/1000., save_presets, NULL);
+			high_slot_program_change(pxk->selected_preset);
+			midi->request_preset_dump(full);
 		}
+		high_slot_selected = -1;
+	}
+	else
+		midi->request_preset_dump();
+	pxk->save_in_progress = true;
+	pxk->started_request = true;
+	got_answer = false;
+	telemetry.item_started(pxk->selected_preset);
+	// if the dump doesn't arrive, try again
+	Fl::add_timeout((3000. + cfg->get_cfg_option(CFG_SPEED)) / 1000., save_presets);
+}
+
+// called when a dump finished (see PXK::preset_dump_complete) or by the watchdog
+void save_presets(void*)
+{
+	Fl::remove_timeout(save_presets);
+	if (pxk->pending_cancel)
+	{
+		pxk->reset();
+		return;
+	}
 
-		pxk->save_in_progress = true;
-		pxk->started_request = true;
-		got_answer = false;
+	if (pxk->started_request)
+	{
+		if (pxk->save_in_progress) // watchdog
+		{
+			midi->reset_handler();
+			pxk->transfer_error();
+			telemetry.timeout();
+			if (download_retries++ < 2)
+			{
+				telemetry.retry();
+				request_bulk_preset();
+				return;
+			}
+			char buf[64];
+			snprintf(buf, 64, "*** Preset %d did not arrive, skipped.\n", pxk->selected_preset);
+			ui->init_log->append(buf);
+			journal.fail();
+		}
+		else if (pxk->selected_preset >= 512 && !high_slot_confirmed())
+		{
+			if (download_retries++ < 2)
+			{
+				telemetry.retry();
+				request_bulk_preset();
+				return;
+			}
+			char buf[64];
+			snprintf(buf, 64, "*** Preset %d could not be confirmed, skipped.\n", pxk->selected_preset);
+			ui->init_log->append(buf);
+			journal.fail();
+		}
+		else
+		{
+			telemetry.item_done(pxk->selected_preset);
+			if (bank.is_open())
+			{
+				if (!pxk->preset->save_archive(&bank, pxk->selected_preset))
+				{
+					bank_export_failed();
+					return;
+				}
+				journal_export(PRESET, pxk->selected_preset);
+			}
+			else
+			{
+				std::string saved;
+				pxk->preset->save_file(pxk->output_dir.c_str(), pxk->selected_preset, &saved);
+				journal_export(PRESET, pxk->selected_preset, saved);
+			}
+		}
+	}
 
+	// skip what an interrupted run of this job already saved
+	while (!pxk->preset_saves.empty() && export_done(PRESET, pxk->preset_saves.front()))
+	{
+		log_skipped(PRESET, pxk->preset_saves.front());
+		pxk->preset_saves.erase(pxk->preset_saves.begin());
 		ui->init_progress->value((float)++init_progress);
 	}
-	else
+	if (pxk->preset_saves.empty())
 	{
-		if (cfg->get_cfg_option(CFG_CLOSED_LOOP_DOWNLOAD))
-			Fl::add_timeout(0.4, save_presets, NULL);
-		else
-			Fl::add_timeout((50. + cfg->get_cfg_option(CFG_SPEED))/1000., save_presets, NULL);
+		journal.finish();
+		pxk->reset();
+		return;
 	}
 
-	return;
+	download_retries = 0;
+	pxk->selected_preset = pxk->preset_saves.front();
+	pxk->preset_saves.erase(pxk->preset_saves.begin());
+	request_bulk_preset();
+
+	ui->init_progress->value((float)++init_progress);
 }
 
-void save_arps(void*)
-{ 
-	if (pxk->started_request && !pxk->pending_cancel)
-		pxk->arp->save_file(pxk->output_dir.c_str(), pxk->selected_arp);
+void PXK::preset_dump_complete()
+{
+	if (single_transfer)
+		single_transfer_done(0);
+	// device is ready for the next request
+	if (downloading_presets && started_request && !save_in_progress)
+	{
+		if (selected_preset >= 512)
+			high_slot_select_next();
+		Fl::add_timeout(0, save_presets);
+	}
+}
 
-	if (pxk->arp_saves.empty() || pxk->pending_cancel)
+// keeps up to ARP_WINDOW arp dump requests in flight
+static void request_bulk_arps()
+{
+	while (arp_pending.size() < ARP_WINDOW && !pxk->arp_saves.empty())
+	{
+		int number = pxk->arp_saves.front();
+		pxk->arp_saves.erase(pxk->arp_saves.begin());
+		// skip what an interrupted run of this job already saved
+		if (export_done(ARP, number))
+		{
+			log_skipped(ARP, number);
+			ui->init_progress->value((float)++init_progress);
+			continue;
+		}
+		arp_pending.push_back(number);
+		telemetry.item_started(number);
+		midi->request_arp_dump(number, pxk->preset_dump_rom);
+	}
+	if (arp_pending.empty())
 	{
+		journal.finish();
 		pxk->reset();
 		return;
 	}
+	pxk->started_request = true;
+	// if the dumps don't arrive, try again
+	Fl::remove_timeout(save_arps);
+	Fl::add_timeout((1500. + 8 * cfg->get_cfg_option(CFG_SPEED)) / 1000., save_arps);
+}
 
-	pxk->selected_arp = pxk->arp_saves.front();
-	pxk->arp_saves.erase(pxk->arp_saves.begin());
+// starts a bulk arp download or, later on, acts as its watchdog
+void save_arps(void*)
+{
+	Fl::remove_timeout(save_arps);
+	if (pxk->pending_cancel)
+	{
+		pxk->reset();
+		return;
+	}
+
+	if (!arp_pending.empty()) // watchdog
+	{
+		midi->reset_handler();
+		pxk->transfer_error();
+		telemetry.timeout();
+		if (arp_retries++ < 2)
+		{
+			telemetry.retry();
+			for (size_t i = 0; i < arp_pending.size(); i++)
+				midi->request_arp_dump(arp_pending[i], pxk->preset_dump_rom);
+			Fl::add_timeout((1500. + 8 * cfg->get_cfg_option(CFG_SPEED)) / 1000., save_arps);
+			return;
+		}
+		char buf[64];
+		snprintf(buf, 64, "*** Arp %d did not arrive, skipped.\n", arp_pending.front());
+		ui->init_log->append(buf);
+		journal.fail();
+		arp_pending.pop_front();
+		ui->init_progress->value((float)++init_progress);
+	}
+
+	arp_retries = 0;
+	downloading_arps = true;
 	pxk->selected_preset_rom = pxk->preset_dump_rom;
+	request_bulk_arps();
+}
 
-	midi->request_arp_dump(pxk->selected_arp, pxk->selected_preset_rom);
-	Fl::add_timeout(0.4 + .008*cfg->get_cfg_option(CFG_SPEED), save_arps, NULL);
+// an arp dump of a bulk transfer arrived (PXK::incoming_arp_dump)
+static void arp_dump_arrived(int number)
+{
+	if (uploading_arps)
+	{
+		if (number != arp_echo_slot)
+			return;
+		// the device has it
+		journal.add(ARP, 0, arp_echo_slot, arp_echo_checksum);
+		telemetry.item_done(arp_echo_slot);
+		arp_echo_slot = -1;
+		Fl::remove_timeout(load_arp_flash);
+		Fl::add_timeout(0, load_arp_flash);
+		return;
+	}
 
-	pxk->started_request = true;
+	std::deque<int>::iterator it = arp_pending.begin();
+	while (it != arp_pending.end() && *it != number)
+		++it;
+	// a late answer to a request we already repeated
+	if (it == arp_pending.end())
+		return;
+	arp_pending.erase(it);
+	arp_retries = 0;
+	telemetry.item_done(number);
 
+	pxk->selected_arp = number;
+	if (bank.is_open())
+	{
+		if (!pxk->arp->save_archive(&bank, number))
+		{
+			bank_export_failed();
+			return;
+		}
+		journal_export(ARP, number);
+	}
+	else
+	{
+		std::string saved;
+		pxk->arp->save_file(pxk->output_dir.c_str(), number, &saved);
+		journal_export(ARP, number, saved);
+	}
 	ui->init_progress->value((float)++init_progress);
 
-	return;
+	if (pxk->pending_cancel)
+	{
+		pxk->reset();
+		return;
+	}
+	request_bulk_arps();
 }
 
 void load_arp_flash(void*)
 {
-	if (pxk->arp_list.empty() || pxk->pending_cancel)
+	Fl::remove_timeout(load_arp_flash);
+	// the device didn't send back the last pattern
+	if (arp_echo_slot >= 0)
+	{
+		telemetry.timeout();
+		journal.fail();
+	}
+	arp_echo_slot = -1;
+	prefetched_file f;
+	if (pxk->pending_cancel || !prefetcher.next(&f))
 	{
+		if (!pxk->pending_cancel)
+			journal.finish();
 		pxk->reset();
 		return;
 	}
 
-	if (pxk->arp_list.size() > 1)
+	// gets next file
+	if (!pxk->arp_list.empty())
+		pxk->arp_list.erase(pxk->arp_list.begin());
+
+	if (prefetcher.remaining() > 0)
 		moar_files = true;
 	else
 	{	
@@ -2557,59 +3486,43 @@ void load_arp_flash(void*)
 		fl_message("Press key combo MULTI->EDIT USER PATTERN on any arp... This commits changes to user memory.");
 	}
 
-	// gets next file
-	std::string filename = pxk->arp_list.front();
-	pxk->arp_list.erase(pxk->arp_list.begin());
-
-#ifdef __linux
-	int offset = 0;
-	while (strncmp(filename.c_str() + offset, "/", 1) != 0)
-		++offset;
-	char n[PATH_MAX];
-	snprintf(n, PATH_MAX, "%s", filename.c_str() + offset);
-	while (n[strlen(n) - 1] == '\n' || n[strlen(n) - 1] == '\r' || n[strlen(n) - 1] == ' ')
-		n[strlen(n) - 1] = '\0';
-	std::ifstream file(n, std::ifstream::binary);
-#else
-	std::ifstream file(filename, std::ifstream::binary);
-#endif
-
-	// check and load file
-	int size;
-	file.seekg(0, std::ios::end);
-	size = file.tellg();
-	file.seekg(0, std::ios::beg);
-	if (size != 285)
-	{
-		file.close();
-		return;
-	}
-	unsigned char* sysex = new unsigned char[size];
-	file.read((char*)sysex, size);
-	file.close();
-	if (!(sysex[0] == 0xf0 && sysex[1] == 0x18 && sysex[2] == 0x0f && sysex[4] == 0x55 && sysex[5] == 0x18 && sysex[size - 1] == 0xf7))
+	if (!f.sysex)
 	{
-		pxk->display_status("Sysex is not an arp");
-		delete[] sysex;
+		pxk->display_status(f.error);
+		journal.fail();
+		// skip it
+		Fl::add_timeout(0, load_arp_flash, NULL);
 		return;
 	}
 
-	pxk->new_arp(size, sysex);
-
+	unsigned int checksum = bank_checksum(f.sysex, f.size);
 	int arp_id = pxk->get_arp_and_increment();
 
-	pxk->arp->load_file(arp_id);
-
-	delete[] sysex;
+	ui->init_progress->value((float)++init_progress);
 
-	if (moar_files == true)
+	// skip what an interrupted run of this job already loaded
+	const journal_entry* done = journal.find(ARP, 0, arp_id);
+	if (done && done->checksum == checksum)
 	{
-		Fl::add_timeout(0.45 + .008*cfg->get_cfg_option(CFG_SPEED), load_arp_flash, NULL);
+		log_skipped(ARP, arp_id);
+		prefetcher.release(&f);
+		Fl::add_timeout(0, load_arp_flash, NULL);
+		return;
 	}
 
-	ui->init_progress->value((float)++init_progress);
+	pxk->new_arp(f.size, f.sysex);
+	pxk->arp->load_file(arp_id);
+	prefetcher.release(&f);
 
-	return;
+	// the device answers in order, so the pattern comes back once it stored it
+	uploading_arps = true;
+	arp_echo_slot = arp_id;
+	arp_echo_checksum = checksum;
+	pxk->started_request = true;
+	telemetry.item_started(arp_id);
+	midi->request_arp_dump(arp_id, 0);
+	// don't wait forever if it doesn't
+	Fl::add_timeout((1500. + 8 * cfg->get_cfg_option(CFG_SPEED)) / 1000., load_arp_flash, NULL);
 }
 
 void download_setup(void*)
@@ -2621,43 +3534,16 @@ void download_setup(void*)
 
 void upload_setup(void*)
 {
-	// gets next file
-	std::string filename = pxk->setup_file;
-
-#ifdef __linux
-	int offset = 0;
-	while (strncmp(filename.c_str() + offset, "/", 1) != 0)
-		++offset;
-	char n[PATH_MAX];
-	snprintf(n, PATH_MAX, "%s", filename.c_str() + offset);
-	while (n[strlen(n) - 1] == '\n' || n[strlen(n) - 1] == '\r' || n[strlen(n) - 1] == ' ')
-		n[strlen(n) - 1] = '\0';
-	std::ifstream file(n, std::ifstream::binary);
-#else
-	std::ifstream file(filename, std::ifstream::binary);
-#endif
-
-	// check and load file
-	int size;
-	file.seekg(0, std::ios::end);
-	size = file.tellg();
-	file.seekg(0, std::ios::beg);
-	if (size < 975 || size > 981)  // a2k setup size unknown - need to verify
-	{
-		pxk->display_status("File is incorrect size");
-		file.close();
+	prefetched_file f;
+	if (!prefetcher.next(&f))
 		return;
-	}
-	unsigned char* sysex = new unsigned char[size];
-	file.read((char*)sysex, size);
-	file.close();
-
-	if (!(sysex[0] == 0xf0 && sysex[1] == 0x18 && sysex[2] == 0x0f && sysex[4] == 0x55 && sysex[5] == 0x1c && sysex[size - 1] == 0xf7))
+	if (!f.sysex)
 	{
-		pxk->display_status("Sysex is not a setup");
-		delete[] sysex;
+		pxk->display_status(f.error);
 		return;
 	}
+	unsigned char* sysex = f.sysex;
+	int size = f.size;
 
 	sysex[0x4A] = pxk->setup_offset;
 
@@ -2671,12 +3557,124 @@ void upload_setup(void*)
 	pxk->save_setup_names(true);
 	pxk->load_setup_names(63);
 
-	delete[] sysex;
+	prefetcher.release(&f);
 
 	return;
 }
 
 
+// opens (or creates) the bank archive of a bulk export folder
+static bool open_bank_archive(const std::string& dir)
+{
+	std::string path = File_Prefetcher::local_path(dir) + "/prodatum" BANK_EXTENSION;
+	if (!bank.open(path.c_str(), true, bank_device_identity(pxk->device_identity())))
+	{
+		pxk->display_status("*** Could not open the bank archive.");
+		fl_message("Could not open the bank archive\n%s:\n%s.", path.c_str(), bank.last_error());
+		return false;
+	}
+	return true;
+}
+
+// adds a chosen file to a bulk import list. bank archives add all their dumps of a type
+static void add_import_file(std::vector<std::string>& list, const char* filename, int type)
+{
+	if (!Bank_Archive::is_archive(filename))
+	{
+		list.push_back(filename);
+		return;
+	}
+	Bank_Archive archive;
+	if (!archive.open(File_Prefetcher::local_path(filename).c_str()))
+	{
+		char buf[PATH_MAX + 64];
+		snprintf(buf, PATH_MAX + 64, "*** %s is not a bank archive.\n", filename);
+		ui->init_log->append(buf);
+		return;
+	}
+	for (int i = 0; i < archive.entries(); i++)
+		if (archive.entry(i)->type == type)
+			list.push_back(File_Prefetcher::archive_entry(filename, i));
+}
+
+void PXK::extract_bank_archive()
+{
+	Fl_File_Chooser chooser(cfg->get_export_dir(),    // directory
+		"*.pdbank",                                   // filter
+		Fl_File_Chooser::SINGLE,                      // chooser type
+		"Bank Archive - Extract - Choose File");      // title
+	chooser.preview(0);
+	chooser.show();
+
+	while (chooser.shown()) Fl::wait();
+
+	if (chooser.value() == NULL || chooser.count() == 0) return;
+
+	Bank_Archive archive;
+	if (!archive.open(File_Prefetcher::local_path(chooser.value()).c_str()))
+	{
+		display_status("*** Not a bank archive.");
+		return;
+	}
+	char buf[64];
+	snprintf(buf, 64, "%d of %d files extracted.", archive.export_files(cfg->get_export_dir()), archive.entries());
+	display_status(buf);
+}
+
+void PXK::export_telemetry()
+{
+	if (telemetry.jobs() == 0)
+	{
+		display_status("*** No transfer statistics yet.");
+		return;
+	}
+	Fl_File_Chooser chooser(cfg->get_export_dir(),    // directory
+		"*.{csv,json}",                               // filter
+		Fl_File_Chooser::CREATE,                      // chooser type
+		"Transfer Statistics - Export - Choose File"); // title
+	chooser.preview(0);
+	chooser.value("prodatum-transfers.csv");
+	chooser.show();
+
+	while (chooser.shown()) Fl::wait();
+
+	if (chooser.value() == NULL) return;
+
+	std::string path = File_Prefetcher::local_path(chooser.value());
+	bool json = path.size() > 5;
+	for (size_t i = 0; json && i < 5; i++)
+		json = tolower((unsigned char) path[path.size() - 5 + i]) == ".json"[i];
+	if (json ? telemetry.export_json(path.c_str()) : telemetry.export_csv(path.c_str()))
+		display_status("Transfer statistics exported.");
+	else
+		display_status("*** Could not write the file.");
+}
+
+void PXK::export_log()
+{
+	if (ui->logbuf->size() == 0)
+	{
+		display_status("*** The message log is empty.");
+		return;
+	}
+	Fl_File_Chooser chooser(cfg->get_export_dir(),    // directory
+		"*.txt",                                      // filter
+		Fl_File_Chooser::CREATE,                      // chooser type
+		"Message Log - Export - Choose File");        // title
+	chooser.preview(0);
+	chooser.value("prodatum-log.txt");
+	chooser.show();
+
+	while (chooser.shown()) Fl::wait();
+
+	if (chooser.value() == NULL) return;
+
+	if (ui->logbuf->export_text(File_Prefetcher::local_path(chooser.value()).c_str()))
+		display_status("Message log exported.");
+	else
+		display_status("*** Could not write the file.");
+}
+
 void PXK::bulk_preset_download() 
 {
 	// Create the file chooser, and show it
@@ -2734,11 +3732,15 @@ void PXK::bulk_preset_download()
 	ep->minimum(0);
 	ep->value(127);
 
+	Fl_Check_Button* ab = new Fl_Check_Button(300, 60, 150, 25, "Bank archive");
+	ab->tooltip("Save into a single bank archive file (" BANK_EXTENSION ") in the folder");
+
 	grp->add(rc);
 	grp->add(sb);
 	grp->add(sp);
 	grp->add(eb);
 	grp->add(ep);
+	grp->add(ab);
 
 	chooser.add_extra(grp);
 	chooser.preview(0);
@@ -2760,6 +3762,7 @@ void PXK::bulk_preset_download()
 	selected_preset = preset_saves[0];
 	preset_dump_rom = rom[rc->value()]->get_romid();
 	output_dir = chooser.value();
+	bool to_archive = ab->value();
 
 	if (grp) delete grp;
 
@@ -2771,6 +3774,12 @@ void PXK::bulk_preset_download()
 
 	pxk->reset();
 
+	if (to_archive && !open_bank_archive(output_dir))
+		return;
+	open_journal(File_Prefetcher::local_path(output_dir) + "/prodatum-presets.journal",
+		export_job("preset", preset_saves, to_archive));
+
+	telemetry_start("Preset download");
 	ui->init_progress->label("Saving User Presets...");
 	ui->init_progress->maximum((float)preset_saves.size());
 	ui->init_progress->value(.0);
@@ -2778,7 +3787,8 @@ void PXK::bulk_preset_download()
 	ui->init->position(ui->main_window->x() + (ui->main_window->w() / 2) - (ui->init->w() / 2),
 		ui->main_window->y() + 80);
 	ui->init->show();
-	
+
+	downloading_presets = true;
 	save_presets(NULL);
 }
 
@@ -2787,11 +3797,11 @@ void PXK::bulk_preset_upload()
 {
 	// Create the file chooser, and show it
 	Fl_File_Chooser chooser(cfg->get_export_dir(),    // directory
-		"*.syx",                    // filter
+		"*.{syx,pdbank}",           // filter
 		Fl_File_Chooser::MULTI,     // chooser type
 		"Preset - Import Select - Choose Files");      // title
 
-	Fl_Group* grp = new Fl_Group(10, 35, 200, 125);
+	Fl_Group* grp = new Fl_Group(10, 35, 250, 140);
 
 	Fl_Spinner* offb = new Fl_Spinner(100, 60, 90, 25, "Bank Offset");
 	offb->align(FL_ALIGN_RIGHT);
@@ -2805,8 +3815,15 @@ void PXK::bulk_preset_upload()
 	offp->minimum(0);
 	offp->value(0);
 
+	Fl_Check_Button* vb = new Fl_Check_Button(100, 120, 150, 25, "Verify");
+	vb->tooltip("Read every uploaded preset back in the background and compare it with its file");
+	Fl_Check_Button* rb = new Fl_Check_Button(100, 145, 150, 25, "Upload failures again");
+	rb->tooltip("Upload presets that failed the verification again");
+
 	grp->add(offb);
 	grp->add(offp);
+	grp->add(vb);
+	grp->add(rb);
 
 	chooser.add_extra(grp);
 	chooser.preview(0);
@@ -2819,14 +3836,18 @@ void PXK::bulk_preset_upload()
 	if (chooser.value() == NULL || chooser.count() == 0) return;
 
 	preset_offset = 128 * offb->value() + offp->value();
+	verify_uploads = vb->value();
+	verify_requeue = verify_uploads && rb->value();
+	verify_rounds = 0;
+	upload_slots.clear();
 
 	char buf[256];
 	preset_list.clear();
 	for (int t = 1; t <= chooser.count(); t++)  // File Chooser is a 1-based list 
+		add_import_file(preset_list, chooser.value(t), PRESET);
+	for (size_t t = 0; t < preset_list.size(); t++)
 	{
-		preset_list.push_back(chooser.value(t));
-
-		sprintf(buf, "loading file:  %s to %d \n\n", preset_list.back().c_str(), preset_offset + t - 1);
+		sprintf(buf, "loading file:  %s to %d \n\n", preset_list[t].c_str(), preset_offset + (int) t);
 		ui->init_log->append(buf);
 	}
 
@@ -2843,16 +3864,26 @@ void PXK::bulk_preset_upload()
 		return;
 	}
 
+	start_preset_upload(import_job("preset", preset_offset, preset_list));
+}
+
+static void start_preset_upload(const std::string& job)
+{
 	pxk->reset();
+	// a re-queued upload would find its slots in the journal
+	if (!job.empty())
+		open_journal(std::string(cfg->get_config_dir()) + "/preset-import.journal", job);
 
+	telemetry_start("Preset upload");
 	ui->init_progress->label("Loading User Presets...");
-	ui->init_progress->maximum((float)preset_list.size());
+	ui->init_progress->maximum((float)pxk->preset_list.size());
 	ui->init_progress->value(.0);
 	init_progress = 0;
 	ui->init->position(ui->main_window->x() + (ui->main_window->w() / 2) - (ui->init->w() / 2),
 		ui->main_window->y() + 80);
 	ui->init->show();
-	
+
+	prefetcher.start(pxk->preset_list, PRESET);
 	load_preset_flash(NULL);
 }
 
@@ -2931,11 +3962,15 @@ void PXK::bulk_pattern_download()
 	ep->minimum(0);
 	ep->value(99);
 
+	Fl_Check_Button* ab = new Fl_Check_Button(300, 60, 150, 25, "Bank archive");
+	ab->tooltip("Save into a single bank archive file (" BANK_EXTENSION ") in the folder");
+
 	grp->add(rc);
 	grp->add(sb);
 	grp->add(sp);
 	grp->add(eb);
 	grp->add(ep);
+	grp->add(ab);
 
 	chooser.add_extra(grp);
 	chooser.preview(0);
@@ -2956,6 +3991,7 @@ void PXK::bulk_pattern_download()
 
 	preset_dump_rom = rom[rc->value()]->get_romid();
 	output_dir = chooser.value();
+	bool to_archive = ab->value();
 
 	if (grp) delete grp;
 
@@ -2967,6 +4003,12 @@ void PXK::bulk_pattern_download()
 
 	pxk->reset();
 
+	if (to_archive && !open_bank_archive(output_dir))
+		return;
+	open_journal(File_Prefetcher::local_path(output_dir) + "/prodatum-arps.journal",
+		export_job("arp", arp_saves, to_archive));
+
+	telemetry_start("Arp download");
 	ui->init_progress->label("Saving User Arp Patterns...");
 	ui->init_progress->maximum((float)arp_saves.size());
 	ui->init_progress->value(.0);
@@ -2983,7 +4025,7 @@ void PXK::bulk_pattern_upload()
 {
 	// Create the file chooser, and show it
 	Fl_File_Chooser chooser(cfg->get_export_dir(),    // directory
-		"*.syx",                    // filter
+		"*.{syx,pdbank}",           // filter
 		Fl_File_Chooser::MULTI,     // chooser type
 		"Arp Pattern - Import Select - Choose Files"); // title
 
@@ -3012,13 +4054,12 @@ void PXK::bulk_pattern_upload()
 	char buf[256];
 	arp_list.clear();
 	for (int t = 1; t <= chooser.count(); t++)  // File Chooser is a 1-based list 
+		add_import_file(arp_list, chooser.value(t), ARP);
+	if (arp_offset + (int) arp_list.size() > 100)
+		arp_list.resize(100 - arp_offset);
+	for (size_t t = 0; t < arp_list.size(); t++)
 	{
-		if (arp_offset + t - 1 > 99)
-			break;
-			
-		arp_list.push_back(chooser.value(t));
-
-		sprintf(buf, "loading file:  %s to %d \n\n", arp_list.back().c_str(), arp_offset + t - 1);
+		sprintf(buf, "loading file:  %s to %d \n\n", arp_list[t].c_str(), arp_offset + (int) t);
 		ui->init_log->append(buf);
 	}
 
@@ -3036,7 +4077,9 @@ void PXK::bulk_pattern_upload()
 	}
 
 	pxk->reset();
+	open_journal(std::string(cfg->get_config_dir()) + "/arp-import.journal", import_job("arp", arp_offset, arp_list));
 
+	telemetry_start("Arp upload");
 	ui->init_progress->label("Loading User Arp Patterns...");
 	ui->init_progress->maximum((float)arp_list.size());
 	ui->init_progress->value(.0);
@@ -3045,6 +4088,7 @@ void PXK::bulk_pattern_upload()
 		ui->main_window->y() + 80);
 	ui->init->show();
 
+	prefetcher.start(arp_list, ARP);
 	load_arp_flash(NULL);
 }
 
@@ -3147,6 +4191,7 @@ void PXK::import_setup()
 
 	pxk->reset();
 
+	prefetcher.start(std::vector<std::string>(1, setup_file), SETUP);
 	upload_setup(NULL);
 }
 
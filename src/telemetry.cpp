@@ -0,0 +1,235 @@
+/*
+ This file is part of prodatum.
+ Copyright 2011-2015 Jan Eidtmann
+
+ prodatum is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ prodatum is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with prodatum.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <algorithm>
+
+#include "telemetry.h"
+#include "debug.h"
+
+// nearest rank percentile of sorted values
+static double percentile(const std::vector<double>& sorted, double p)
+{
+	if (sorted.empty())
+		return 0.;
+	size_t rank = (size_t) (p * sorted.size() + .5);
+	if (rank > 0)
+		--rank;
+	if (rank >= sorted.size())
+		rank = sorted.size() - 1;
+	return sorted[rank];
+}
+
+Transfer_Telemetry::Transfer_Telemetry() :
+		active(false)
+{
+}
+
+double Transfer_Telemetry::elapsed() const
+{
+	return std::chrono::duration<double>(clock::now() - start_time).count();
+}
+
+void Transfer_Telemetry::start(const char* job)
+{
+	pmesg("Transfer_Telemetry::start(%s)\n", job);
+	if (active)
+		finish(false);
+	current = telemetry_record();
+	current.job = job;
+	current.started = time(0);
+	start_time = last_item = clock::now();
+	pending.clear();
+	latencies.clear();
+	active = true;
+}
+
+void Transfer_Telemetry::finish(bool completed)
+{
+	if (!active)
+		return;
+	active = false;
+	current.seconds = elapsed();
+	current.completed = completed;
+	std::sort(latencies.begin(), latencies.end());
+	current.latency_p50 = percentile(latencies, .5);
+	current.latency_p90 = percentile(latencies, .9);
+	current.latency_p99 = percentile(latencies, .99);
+	current.latency_max = latencies.empty() ? 0. : latencies.back();
+	if (history.size() >= TELEMETRY_HISTORY)
+		history.erase(history.begin());
+	history.push_back(current);
+	pending.clear();
+	latencies.clear();
+	pmesg("Transfer_Telemetry::finish() %s\n", report(current).c_str());
+}
+
+bool Transfer_Telemetry::running() const
+{
+	return active;
+}
+
+void Transfer_Telemetry::sent(unsigned int bytes)
+{
+	if (!active)
+		return;
+	current.bytes_out += bytes;
+	++current.messages_out;
+}
+
+void Transfer_Telemetry::received(unsigned int bytes)
+{
+	if (!active)
+		return;
+	current.bytes_in += bytes;
+	++current.messages_in;
+}
+
+void Transfer_Telemetry::item_started(int key)
+{
+	if (active)
+		pending[key] = clock::now();
+}
+
+void Transfer_Telemetry::item_done(int key)
+{
+	if (!active)
+		return;
+	clock::time_point now = clock::now();
+	clock::time_point from = last_item;
+	std::map<int, clock::time_point>::iterator it = pending.find(key);
+	if (it != pending.end())
+	{
+		from = it->second;
+		pending.erase(it);
+	}
+	latencies.push_back(std::chrono::duration<double, std::milli>(now - from).count());
+	last_item = now;
+	++current.items;
+}
+
+void Transfer_Telemetry::retry()
+{
+	if (active)
+		++current.retries;
+}
+
+void Transfer_Telemetry::timeout()
+{
+	if (active)
+		++current.timeouts;
+}
+
+std::string Transfer_Telemetry::summary(double done, double total) const
+{
+	if (!active)
+		return std::string();
+	double t = elapsed();
+	if (t < .001)
+		t = .001;
+	std::vector<double> sorted(latencies);
+	std::sort(sorted.begin(), sorted.end());
+	char eta[16] = "-";
+	if (done > 0. && total > done)
+	{
+		int s = (int) (t / done * (total - done) + .5);
+		snprintf(eta, 16, "%d:%02d", s / 60, s % 60);
+	}
+	char buf[256];
+	snprintf(buf, 256, "In %.1f kB/s  Out %.1f kB/s  %.1f msg/s  ETA %s\n"
+			"Latency p50 %.0f p90 %.0f ms  Retries %u  Timeouts %u", current.bytes_in / t / 1000.,
+			current.bytes_out / t / 1000., (current.messages_in + current.messages_out) / t, eta, percentile(sorted, .5),
+			percentile(sorted, .9), current.retries, current.timeouts);
+	return buf;
+}
+
+std::string Transfer_Telemetry::report(const telemetry_record& r)
+{
+	double t = r.seconds < .001 ? .001 : r.seconds;
+	char buf[320];
+	snprintf(buf, 320, "%s %s: %u items in %.1f s, in %lu bytes (%.1f kB/s), out %lu bytes (%.1f kB/s), "
+			"%.1f msg/s, latency p50/p90/p99 %.0f/%.0f/%.0f ms, %u retries, %u timeouts", r.job.c_str(),
+			r.completed ? "completed" : "cancelled", r.items, r.seconds, r.bytes_in, r.bytes_in / t / 1000., r.bytes_out,
+			r.bytes_out / t / 1000., (r.messages_in + r.messages_out) / t, r.latency_p50, r.latency_p90, r.latency_p99,
+			r.retries, r.timeouts);
+	return buf;
+}
+
+const telemetry_record* Transfer_Telemetry::last() const
+{
+	if (history.empty())
+		return 0;
+	return &history.back();
+}
+
+size_t Transfer_Telemetry::jobs() const
+{
+	return history.size();
+}
+
+static void format_time(time_t t, char* buf, size_t len)
+{
+	struct tm* tm = localtime(&t);
+	if (!tm || !strftime(buf, len, "%Y-%m-%dT%H:%M:%S", tm))
+		snprintf(buf, len, "%ld", (long) t);
+}
+
+bool Transfer_Telemetry::export_csv(const char* filename) const
+{
+	FILE* f = fopen(filename, "w");
+	if (!f)
+		return false;
+	fprintf(f, "job,started,seconds,completed,items,bytes_out,bytes_in,messages_out,messages_in,messages_per_second,"
+			"retries,timeouts,latency_p50_ms,latency_p90_ms,latency_p99_ms,latency_max_ms\n");
+	char started[32];
+	for (size_t i = 0; i < history.size(); i++)
+	{
+		const telemetry_record& r = history[i];
+		double t = r.seconds < .001 ? .001 : r.seconds;
+		format_time(r.started, started, 32);
+		fprintf(f, "\"%s\",%s,%.3f,%d,%u,%lu,%lu,%lu,%lu,%.2f,%u,%u,%.1f,%.1f,%.1f,%.1f\n", r.job.c_str(), started,
+				r.seconds, r.completed, r.items, r.bytes_out, r.bytes_in, r.messages_out, r.messages_in,
+				(r.messages_in + r.messages_out) / t, r.retries, r.timeouts, r.latency_p50, r.latency_p90, r.latency_p99,
+				r.latency_max);
+	}
+	return fclose(f) == 0;
+}
+
+bool Transfer_Telemetry::export_json(const char* filename) const
+{
+	FILE* f = fopen(filename, "w");
+	if (!f)
+		return false;
+	fprintf(f, "[");
+	char started[32];
+	for (size_t i = 0; i < history.size(); i++)
+	{
+		const telemetry_record& r = history[i];
+		double t = r.seconds < .001 ? .001 : r.seconds;
+		format_time(r.started, started, 32);
+		fprintf(f, "%s\n  {\"job\": \"%s\", \"started\": \"%s\", \"seconds\": %.3f, \"completed\": %s, \"items\": %u,"
+				" \"bytes_out\": %lu, \"bytes_in\": %lu, \"messages_out\": %lu, \"messages_in\": %lu,"
+				" \"messages_per_second\": %.2f, \"retries\": %u, \"timeouts\": %u,"
+				" \"latency_ms\": {\"p50\": %.1f, \"p90\": %.1f, \"p99\": %.1f, \"max\": %.1f}}", i ? "," : "",
+				r.job.c_str(), started, r.seconds, r.completed ? "true" : "false", r.items, r.bytes_out, r.bytes_in,
+				r.messages_out, r.messages_in, (r.messages_in + r.messages_out) / t, r.retries, r.timeouts,
+				r.latency_p50, r.latency_p90, r.latency_p99, r.latency_max);
+	}
+	fprintf(f, "\n]\n");
+	return fclose(f) == 0;
+}
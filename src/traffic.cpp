@@ -0,0 +1,142 @@
+/*
+ This file is part of prodatum.
+ Copyright 2011-2015 Jan Eidtmann
+
+ prodatum is free software: you can redistribute it and/or modify
+ it under the terms of the GNU General Public License as published by
+ the Free Software Foundation, either version 3 of the License, or
+ (at your option) any later version.
+
+ prodatum is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with prodatum.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+
+#include "traffic.h"
+#include "debug.h"
+
+static const char* type_names[] =
+{ "I", "O", "IE", "OE" };
+
+static const char hex[] = "0123456789ABCDEF";
+
+Traffic_Log::Traffic_Log(unsigned int size) :
+		ring(size ? size : 1), head(0), used(0), dropped(0), start(clock::now()), changed_cb(0), changed_data(0)
+{
+	count[0] = count[1] = count[2] = count[3] = 0;
+}
+
+void Traffic_Log::add(unsigned char type, const unsigned char* data, unsigned int len)
+{
+	if (type > LOG_EVENT_OUT)
+		return;
+	unsigned int size = ring.size();
+	if (len > size) // keep the end
+	{
+		data += len - size;
+		len = size;
+	}
+	// make room
+	while (!records.empty() && used + len > size)
+	{
+		used -= records.front().length;
+		records.pop_front();
+		++dropped;
+	}
+	log_record r;
+	r.time = std::chrono::duration<double>(clock::now() - start).count();
+	r.number = ++count[type];
+	r.offset = head;
+	r.length = len;
+	r.type = type;
+	for (unsigned int i = 0; i < len; i++)
+	{
+		ring[head] = data[i];
+		if (++head == size)
+			head = 0;
+	}
+	used += len;
+	records.push_back(r);
+	if (changed_cb)
+		changed_cb(changed_data);
+}
+
+void Traffic_Log::clear()
+{
+	dropped += records.size();
+	records.clear();
+	head = used = 0;
+	if (changed_cb)
+		changed_cb(changed_data);
+}
+
+size_t Traffic_Log::size() const
+{
+	return records.size();
+}
+
+unsigned long Traffic_Log::first() const
+{
+	return dropped;
+}
+
+int Traffic_Log::prefix(const log_record& r, char* buf, int len) const
+{
+	return snprintf(buf, len, "%.3f %s.%u::", r.time, type_names[r.type], r.number);
+}
+
+size_t Traffic_Log::text_length(size_t i) const
+{
+	if (i >= records.size())
+		return 0;
+	char buf[48];
+	return prefix(records[i], buf, 48) + 2 * records[i].length;
+}
+
+std::string Traffic_Log::text(size_t i) const
+{
+	if (i >= records.size())
+		return std::string();
+	const log_record& r = records[i];
+	char buf[48];
+	int n = prefix(r, buf, 48);
+	std::string s;
+	s.reserve(n + 2 * r.length);
+	s.append(buf, n);
+	unsigned int size = ring.size();
+	for (unsigned int j = 0, o = r.offset; j < r.length; j++)
+	{
+		s += hex[ring[o] >> 4];
+		s += hex[ring[o] & 0xf];
+		if (++o == size)
+			o = 0;
+	}
+	return s;
+}
+
+bool Traffic_Log::export_text(const char* filename) const
+{
+	pmesg("Traffic_Log::export_text(%s)\n", filename);
+	FILE* f = fopen(filename, "w");
+	if (!f)
+		return false;
+	for (size_t i = 0; i < records.size(); i++)
+	{
+		std::string s = text(i);
+		fwrite(s.c_str(), 1, s.size(), f);
+		fputc('\n', f);
+	}
+	return fclose(f) == 0;
+}
+
+void Traffic_Log::callback(void (*cb)(void*), void* data)
+{
+	changed_cb = cb;
+	changed_data = data;
+}
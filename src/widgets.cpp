@@ -21,12 +21,16 @@
 #include <FL/filename.H>
 #include <math.h>
 #include <string.h>
+#include <stdint.h>
+#include <algorithm>
+#include <map>
 
 #ifdef WIN32
 	#include <corecrt_math_defines.h>
 #endif
 
 #include "ui.h"
+#include "names.h"
 /**
  * global array that holds all device parameter widgets.
  * every parameter can be accessed by their ID and layer.
@@ -34,6 +38,8 @@
 PWid* pwid[2000][4];
 /// pointer to widgets that is currently being edited
 PWid* pwid_editing;
+/// the widgets of pwid[][] by group
+PWid_Registry pwid_registry;
 // knob colors
 char c_knob_1 = FL_BACKGROUND2_COLOR;
 char c_knob_2 = FL_BACKGROUND2_COLOR;
@@ -148,6 +154,44 @@ void PWid::cb(PWid*, void* p)
 	}
 }
 
+// ###################
+//
+// ###################
+void PWid_Registry::add(int group, int first, int last, int layers)
+{
+	for (int id = first; id <= last; id++)
+		for (int l = 0; l < layers; l++)
+			if (pwid[id][l])
+			{
+				pwid_entry e =
+				{ id, l, pwid[id][l] };
+				groups[group].push_back(e);
+			}
+}
+
+void PWid_Registry::build()
+{
+	groups[PWID_PRESET].clear();
+	add(PWID_PRESET, 915, 1152, 1);
+	add(PWID_PRESET, 1169, 1300, 1);
+	groups[PWID_LAYER].clear();
+	add(PWID_LAYER, 1409, 1992, 4);
+	groups[PWID_SETUP].clear();
+	add(PWID_SETUP, 130, 512, 1);
+	add(PWID_SETUP, 529, 787, 1);
+	build_fx();
+	pmesg("PWid_Registry::build() preset %d, layer %d, setup %d widgets\n", (int) groups[PWID_PRESET].size(),
+			(int) groups[PWID_LAYER].size(), (int) groups[PWID_SETUP].size());
+}
+
+void PWid_Registry::build_fx()
+{
+	groups[PWID_FX_MASTER].clear();
+	add(PWID_FX_MASTER, 513, 528, 1);
+	groups[PWID_FX_PRESET].clear();
+	add(PWID_FX_PRESET, 1153, 1168, 1);
+}
+
 // ###################
 //
 // ###################
@@ -309,7 +353,7 @@ int Browser::get_value() const
 	// update instrument names in channel strips
 	if (id_layer[0] == 1409)
 	{
-		ui->main->layer_strip[id_layer[1]]->instrument->label(text(v) + 5);
+		ui->main->layer_strip[id_layer[1]]->instrument->copy_label(text(v) + 5);
 		if (v != 1)
 		{
 			if (!ui->main->layer_strip[id_layer[1]]->active())
@@ -373,7 +417,7 @@ void Browser::set_value(int v)
 		else if (id_layer[0] == 1409)
 		{
 			if (v >= 0 && v < size())
-				ui->main->layer_strip[id_layer[1]]->instrument->label(text(v + 1) + 5);
+				ui->main->layer_strip[id_layer[1]]->instrument->copy_label(text(v + 1) + 5);
 			if (v != 0)
 			{
 				if (!ui->main->layer_strip[id_layer[1]]->active())
@@ -387,8 +431,121 @@ void Browser::set_value(int v)
 
 void Browser::reset()
 {
-	Fl_Browser::clear();
 	selected_rom = -1;
+	filtered = false;
+	shown.clear();
+	new_list();
+}
+
+bool Browser::has_off_row() const
+{
+	return id_layer[0] == 1281 || id_layer[0] == 1290;
+}
+
+int Browser::size() const
+{
+	if (selected_rom == -1 || !pxk)
+		return 0;
+	unsigned char rom_ = pxk->get_rom_index(selected_rom);
+	if (rom_ == 5 || !pxk->rom[rom_])
+		return 0;
+	int number = pxk->rom[rom_]->get_attribute(selected_type);
+	if (number < 0)
+		number = 0;
+	return has_off_row() ? number + 1 : number;
+}
+
+const char* Browser::text(int line) const
+{
+	row_text[0] = '\0';
+	if (line < 1 || line > size())
+		return row_text;
+	if (has_off_row())
+	{
+		if (line == 1)
+			return "Off";
+		--line;
+	}
+	const unsigned char* name = pxk->rom[pxk->get_rom_index(selected_rom)]->get_name(selected_type, line - 1);
+	snprintf(row_text, 24, id_layer[0] == 1409 ? "%04d %.16s" : "%03d %.16s", line - 1, name ? (const char*) name : "");
+	return row_text;
+}
+
+int Browser::value() const
+{
+	return (int) (intptr_t) selection();
+}
+
+int Browser::select(int line, int val)
+{
+	if (line < 1 || line > size())
+		return 0;
+	return Fl_Browser_::select((void*) (intptr_t) line, val);
+}
+
+void* Browser::item_first() const
+{
+	if (filtered)
+		return shown.empty() ? 0 : (void*) (intptr_t) shown.front();
+	return size() ? (void*) 1 : 0;
+}
+
+void* Browser::item_last() const
+{
+	if (filtered)
+		return shown.empty() ? 0 : (void*) (intptr_t) shown.back();
+	return (void*) (intptr_t) size();
+}
+
+void* Browser::item_next(void* item) const
+{
+	int line = (int) (intptr_t) item;
+	if (filtered)
+	{
+		std::vector<int>::const_iterator it = std::upper_bound(shown.begin(), shown.end(), line);
+		return it == shown.end() ? 0 : (void*) (intptr_t) *it;
+	}
+	return line < size() ? (void*) (intptr_t) (line + 1) : 0;
+}
+
+void* Browser::item_prev(void* item) const
+{
+	int line = (int) (intptr_t) item;
+	if (filtered)
+	{
+		std::vector<int>::const_iterator it = std::lower_bound(shown.begin(), shown.end(), line);
+		return it == shown.begin() ? 0 : (void*) (intptr_t) *(it - 1);
+	}
+	return line > 1 ? (void*) (intptr_t) (line - 1) : 0;
+}
+
+int Browser::item_height(void*) const
+{
+	fl_font(textfont(), textsize());
+	return fl_height() + 2;
+}
+
+int Browser::item_width(void* item) const
+{
+	fl_font(textfont(), textsize());
+	return (int) fl_width(text((int) (intptr_t) item)) + 6;
+}
+
+int Browser::full_height() const
+{
+	return (filtered ? shown.size() : size()) * item_height(0);
+}
+
+void Browser::item_draw(void* item, int X, int Y, int W, int H) const
+{
+	fl_font(textfont(), textsize());
+	Fl_Color c = textcolor();
+	if (item_selected(item))
+		c = fl_contrast(c, selection_color());
+	if (!active_r())
+		c = fl_inactive(c);
+	fl_color(c);
+	fl_draw(text((int) (intptr_t) item), X + 3, Y, W - 6, H, FL_ALIGN_LEFT, 0, 0);
 }
 
 void Browser::load_n(int type, int rom_id, int preset)
@@ -400,56 +557,32 @@ void Browser::load_n(int type, int rom_id, int preset)
 	if (!pxk->rom[rom_])
 		return;
 	int val = value();
-	// only load a new list if its different from the loaded one
-	if (selected_rom != rom_id || preset != -1)
+	// a single name of the loaded list changed
+	if (preset != -1)
 	{
+		if (selected_rom == rom_id && selected_type == type)
+			redraw();
+	}
+	// only switch the list if its different from the loaded one
+	else if (selected_rom != rom_id || selected_type != type)
+	{
+		// rows are formatted from the name table when they are drawn
 		selected_rom = rom_id;
-		char name[22];
-		// load a new list
-		if (preset == -1)
+		selected_type = type;
+		filtered = false;
+		shown.clear();
+		new_list();
+		if (val <= size() && val > 0)
 		{
-			int number = pxk->rom[rom_]->get_attribute(type);
-			const unsigned char* names = pxk->rom[rom_]->get_name(type, 0);
-			clear();
-			if (id_layer[0] == 1409) // instruments
-			{
-				for (int i = 0; i < number; i++)
-				{
-					snprintf(name, 22, "%04d %s", i, names + i * 16);
-					add(name);
-				}
-			}
-			else
-			{
-				if (id_layer[0] == 1281 || id_layer[0] == 1290) // preset links
-					add("Off");
-				for (int i = 0; i < number; i++)
-				{
-					snprintf(name, 21, "%03d %s", i, names + i * 16);
-					add(name);
-				}
-			}
-			if (val <= size() && val > 0)
-			{
-				select(val);
-				apply_filter();
-			}
-		}
-		// replace single item
-		else
-		{
-			snprintf(name, 21, "%03d %s", preset, pxk->rom[rom_]->get_name(type, preset));
-			if (id_layer[0] == 1281 || id_layer[0] == 1290) // preset links
-				text(preset + 2, name);
-			else
-				text(preset + 1, name);
+			select(val);
+			apply_filter();
 		}
 	}
 	// update instrument names in channel strips
 	if (id_layer[0] == 1409)
 	{
 		if (val > 0 && val <= size())
-			ui->main->layer_strip[id_layer[1]]->instrument->label(text(val) + 5);
+			ui->main->layer_strip[id_layer[1]]->instrument->copy_label(text(val) + 5);
 	}
 }
 
@@ -470,29 +603,58 @@ void Browser::apply_filter()
 	static char f[19];
 	int i;
 	int l = snprintf(f, 19, "*%s*", filter);
-	if (l > 2)
-	{
-		for (i = 1; i < l - 1; i++)
-			if (f[i] < (0x20 & 0x7f) || f[i] > (0x7e & 0x7f))
-				f[i] = 0x3f;
-		for (i = 1; i <= size(); i++)
+	if (l > 18) // truncated
+	{
+		l = 18;
+		f[17] = '*';
+	}
+	for (i = 1; i < l - 1; i++)
+		if (f[i] < (0x20 & 0x7f) || f[i] > (0x7e & 0x7f))
+			f[i] = 0x3f;
+	// rows matching the filter
+	std::vector<int> rows;
+	bool all = l <= 2;
+	if (!all)
+	{
+		// the name table index, shared by all browsers of this table
+		Name_Index* index = pxk->rom[pxk->get_rom_index(selected_rom)]->name_index(selected_type);
+		f[l - 1] = '\0'; // the query without our wildcards
+		if (index && !strpbrk(f + 1, "*?[{"))
 		{
-			if (fl_filename_match(text(i), f))
-				show(i);
-			else
-				hide(i);
+			int offset = 1;
+			if (has_off_row())
+			{
+				if (Name_Index::contains(text(1), f + 1))
+					rows.push_back(1);
+				offset = 2;
+			}
+			const std::vector<int>& match = index->match(f + 1);
+			for (size_t m = 0; m < match.size() && match[m] + offset <= size(); m++)
+				rows.push_back(match[m] + offset);
 		}
+		else // wildcards
+		{
+			f[l - 1] = '*';
+			for (i = 1; i <= size(); i++)
+				if (fl_filename_match(text(i), f))
+					rows.push_back(i);
+		}
+		// keep the selection visible
+		if (val > 0 && !std::binary_search(rows.begin(), rows.end(), val))
+			rows.insert(std::lower_bound(rows.begin(), rows.end(), val), val);
+	}
+	// swap the visible rows if they changed
+	if (filtered != !all || rows != shown)
+	{
+		filtered = !all;
+		shown.swap(rows);
+		new_list();
 	}
-	else
-		for (i = 1; i <= size(); i++)
-			show(i);
 	// scroll the list
 	if (val > 0)
 	{
-		show(val);
-		topline(1); // fixes issues with the scrollbar not being updated correctly
-		deselect();
 		select(val);
+		display((void*) (intptr_t) val);
 	}
 }
 
@@ -621,12 +783,16 @@ int Browser::handle(int ev)
 			key = Fl::event_key();
 			if (key == FL_Down)
 			{
-				select(value() + 1);
+				void* next = value() ? item_next((void*) (intptr_t) value()) : item_first();
+				if (next)
+					select((int) (intptr_t) next);
 				return 1;
 			}
 			if (key == FL_Up)
 			{
-				select(value() - 1);
+				void* prev = value() ? item_prev((void*) (intptr_t) value()) : 0;
+				if (prev)
+					select((int) (intptr_t) prev);
 				return 1;
 			}
 			if (key == FL_Enter || key == 32) // copy/save with enter or space key
@@ -699,7 +865,7 @@ int Browser::handle(int ev)
 			if (this != Fl::belowmouse())
 				return 0;
 	}
-	return Fl_Browser::handle(ev);
+	return Fl_Browser_::handle(ev);
 }
 
 // ###################
@@ -2143,6 +2309,16 @@ void Fl_Knob::dependency(int v) const
 	}
 }
 
+// rendered knob bodies by side, scale ticks and state
+static std::map<int, Fl_Offscreen> knob_sprites;
+
+void Fl_Knob::clear_sprites()
+{
+	for (std::map<int, Fl_Offscreen>::iterator it = knob_sprites.begin(); it != knob_sprites.end(); ++it)
+		fl_delete_offscreen(it->second);
+	knob_sprites.clear();
+}
+
 void Fl_Knob::draw()
 {
 	int ox, oy, ww, hh, side;
@@ -2163,48 +2339,63 @@ void Fl_Knob::draw()
 		oy = oy + (hh - side) / 2;
 	}
 	side = w() > h() ? hh : ww;
+	if (side > 0)
+	{
+		// 0 = inactive, 1 = active, 2 = focused
+		char state = active_r() ? (this == Fl::focus() ? 2 : 1) : 0;
+		Fl_Offscreen& body = knob_sprites[(side << 8) | (_scaleticks << 2) | state];
+		if (!body)
+		{
+			body = fl_create_offscreen(side, side);
+			fl_begin_offscreen(body);
+			draw_body(side, state);
+			fl_end_offscreen();
+		}
+		fl_copy_offscreen(ox, oy, side, side, body, 0, 0);
+		draw_cursor(ox, oy, side);
+	}
+	fl_pop_clip();
+}
+
+void Fl_Knob::draw_body(const int side, const char state)
+{
 	// background
 	fl_color(FL_BACKGROUND_COLOR);
-	fl_rectf(ox, oy, side, side);
+	fl_rectf(0, 0, side, side);
 	// scale
-	(active_r()) ?
+	(state) ?
 			fl_color(fl_color_average((Fl_Color) c_knob_2, FL_BACKGROUND_COLOR, .5)) :
 			fl_color(fl_color_average((Fl_Color) c_knob_2, FL_BACKGROUND_COLOR, .2));
-	fl_pie(ox + 1, oy + 3, side - 2, side - 12, 0, 360);
-	draw_scale(ox, oy, side);
-	fl_pie(ox + 7, oy + 7, side - 14, side - 14, 0, 360);
+	fl_pie(1, 3, side - 2, side - 12, 0, 360);
+	draw_scale(0, 0, side);
+	fl_pie(7, 7, side - 14, side - 14, 0, 360);
 	// shadow
 	fl_color(fl_color_average(FL_BACKGROUND_COLOR, FL_BLACK, .9));
-	fl_pie(ox + 8, oy + 12, side - 16, side - 16, 0, 360);
+	fl_pie(8, 12, side - 16, side - 16, 0, 360);
 	fl_color(fl_color_average(FL_BACKGROUND_COLOR, FL_BLACK, .7));
-	fl_pie(ox + 9, oy + 12, side - 18, side - 18, 0, 360);
+	fl_pie(9, 12, side - 18, side - 18, 0, 360);
 	// knob edge
-//	fl_color(active_r() ? FL_BACKGROUND2_COLOR : fl_color_average(FL_BACKGROUND2_COLOR, FL_BACKGROUND_COLOR, .5));
-	fl_color(active_r() ? FL_BLACK : fl_color_average(FL_BLACK, FL_BACKGROUND_COLOR, .5));
-	fl_pie(ox + 9, oy + 9, side - 18, side - 18, 0, 360);
+//	fl_color(state ? FL_BACKGROUND2_COLOR : fl_color_average(FL_BACKGROUND2_COLOR, FL_BACKGROUND_COLOR, .5));
+	fl_color(state ? FL_BLACK : fl_color_average(FL_BLACK, FL_BACKGROUND_COLOR, .5));
+	fl_pie(9, 9, side - 18, side - 18, 0, 360);
 	// top
-	if (active_r())
-		(this == Fl::focus()) ?
+	if (state)
+		(state == 2) ?
 				fl_color(FL_SELECTION_COLOR) : fl_color(fl_color_average((Fl_Color) c_knob_1, FL_BACKGROUND_COLOR, .8));
 	else
 		fl_color(fl_color_average((Fl_Color) c_knob_1, FL_BACKGROUND_COLOR, .5));
-	fl_pie(ox + 10, oy + 10, side - 20, side - 20, 0, 360);
-//	if (active_r())
-	{
-		unsigned char rr, gg, bb;
-		Fl::get_color((Fl_Color) fl_color(), rr, gg, bb);
-		shadow(10, rr, gg, bb);
-		fl_pie(ox + 10, oy + 10, side - 20, side - 20, 110, 150);
-		fl_pie(ox + 10, oy + 10, side - 20, side - 20, 290, 330);
-		shadow(17, rr, gg, bb);
-		fl_pie(ox + 10, oy + 10, side - 20, side - 20, 120, 140);
-		fl_pie(ox + 10, oy + 10, side - 20, side - 20, 300, 320);
-		shadow(25, rr, gg, bb);
-		fl_pie(ox + 10, oy + 10, side - 20, side - 20, 127, 133);
-		fl_pie(ox + 10, oy + 10, side - 20, side - 20, 307, 313);
-	}
-	draw_cursor(ox, oy, side);
-	fl_pop_clip();
+	fl_pie(10, 10, side - 20, side - 20, 0, 360);
+	unsigned char rr, gg, bb;
+	Fl::get_color((Fl_Color) fl_color(), rr, gg, bb);
+	shadow(10, rr, gg, bb);
+	fl_pie(10, 10, side - 20, side - 20, 110, 150);
+	fl_pie(10, 10, side - 20, side - 20, 290, 330);
+	shadow(17, rr, gg, bb);
+	fl_pie(10, 10, side - 20, side - 20, 120, 140);
+	fl_pie(10, 10, side - 20, side - 20, 300, 320);
+	shadow(25, rr, gg, bb);
+	fl_pie(10, 10, side - 20, side - 20, 127, 133);
+	fl_pie(10, 10, side - 20, side - 20, 307, 313);
 }
 
 void Fl_Knob::shadow(const int offs, const uchar r, uchar g, uchar b)
@@ -2979,6 +3170,7 @@ void Choice::dependency(int v) const
 			ui->fxb_send2->set_id(1165);
 			ui->fxb_send3->set_id(1166);
 			ui->fxb_send4->set_id(1168);
+			pwid_registry.build_fx();
 		}
 		else
 		{
@@ -3018,6 +3210,7 @@ void Choice::dependency(int v) const
 			ui->fxb_send2->set_id(525);
 			ui->fxb_send3->set_id(526);
 			ui->fxb_send4->set_id(528);
+			pwid_registry.build_fx();
 		}
 	}
 	else if (id_layer[0] == 271) // superbeats mode
@@ -3292,14 +3485,12 @@ void Envelope_Editor::draw_b_label(char butt, Fl_Color col)
 	}
 }
 
-void Envelope_Editor::draw()
+void Envelope_Editor::layout(int x, int y)
 {
-// box
-	Fl_Box::draw_box();
 	ee_w = this->w() - 2;
 	ee_h = this->h() - 2;
-	ee_x0 = this->x() + 1;
-	ee_y0 = this->y() + 1;
+	ee_x0 = x + 1;
+	ee_y0 = y + 1;
 	mode_button[0] = ee_x0 + ee_w - 164;
 	mode_button[1] = mode_button[0] + 55;
 	mode_button[2] = mode_button[1] + 55;
@@ -3315,6 +3506,41 @@ void Envelope_Editor::draw()
 	shape_button[1] = shape_button[0] - 20;
 	shape_button[2] = shape_button[1] - 20;
 	shape_button[3] = shape_button[2] - 20;
+}
+
+void Envelope_Editor::get_background_state(background_state* s)
+{
+	memset(s, 0, sizeof(background_state));
+	s->w = w();
+	s->h = h();
+	s->colors[0] = Fl::get_color(color());
+	s->colors[1] = Fl::get_color(FL_BACKGROUND_COLOR);
+	s->colors[2] = Fl::get_color(FL_BACKGROUND2_COLOR);
+	s->colors[3] = Fl::get_color(FL_FOREGROUND_COLOR);
+	s->colors[4] = Fl::get_color(FL_INACTIVE_COLOR);
+	s->colors[5] = Fl::get_color(FL_SELECTION_COLOR);
+	// the stages of the edited envelope are drawn live
+	for (unsigned char i = 0; i < 3; i++)
+	{
+		if (i != mode)
+			memcpy(s->env[i].stage, env[i].stage, sizeof(env[i].stage));
+		s->env[i].mode = env[i].mode;
+		s->env[i].repeat = env[i].repeat;
+	}
+	s->mode = mode;
+	s->zoomlevel = zoomlevel;
+	s->button_hover = button_push ? button_hover : -1;
+	s->overlay = overlay;
+	s->syncview = ui->syncview;
+	s->active = active_r();
+	s->button_push = button_push;
+}
+
+void Envelope_Editor::draw_background(int x, int y)
+{
+// box
+	draw_box(box(), x, y, w(), h(), color());
+	layout(x, y);
 // title
 	fl_font(FL_HELVETICA_BOLD, 14);
 	fl_color(FL_FOREGROUND_COLOR);
@@ -3474,12 +3700,38 @@ void Envelope_Editor::draw()
 		fl_color(nulll);
 		fl_font(FL_COURIER, 13);
 		fl_draw("(using factory envelope)", x0 + 100, y0 + 15);
-		return;
 	}
-	if (active_r())
-		draw_envelope(mode, x0, y0, luma);
-	if (!active_r())
+}
+
+void Envelope_Editor::draw()
+{
+	// render the static parts when they changed
+	background_state state;
+	get_background_state(&state);
+	if (!background || memcmp(&state, &background_drawn, sizeof(background_state)))
+	{
+		if (background && (state.w != background_drawn.w || state.h != background_drawn.h))
+		{
+			fl_delete_offscreen(background);
+			background = 0;
+		}
+		if (!background)
+			background = fl_create_offscreen(w(), h());
+		fl_begin_offscreen(background);
+		draw_background(0, 0);
+		fl_end_offscreen();
+		memcpy(&background_drawn, &state, sizeof(background_state));
+	}
+	fl_copy_offscreen(x(), y(), w(), h(), background, 0, 0);
+	layout(x(), y());
+	if (!active_r() || (mode == VOLUME && env[VOLUME].mode == FACTORY))
 		return;
+// the edited envelope
+	int x0 = ee_x0 + 5;
+	float y0 = (float) ee_y0 + 25. + ((float) ee_h - 50.) / 2.;
+	unsigned char r, g, b, i;
+	Fl::get_color(FL_BACKGROUND2_COLOR, r, g, b);
+	draw_envelope(mode, x0, y0, (r + r + b + g + g + g) / 6);
 // value fields
 	fl_color(FL_INACTIVE_COLOR);
 // calc number of hovers
@@ -4134,6 +4386,12 @@ int Envelope_Editor::handle(int ev)
 	return Fl_Box::handle(ev);
 }
 
+Envelope_Editor::~Envelope_Editor()
+{
+	if (background)
+		fl_delete_offscreen(background);
+}
+
 void Envelope_Editor::set_data(unsigned char type, int* stages, char mode, char repeat)
 {
 //pmesg("Envelope_Editor::set_data(%d, int*, %d, %d)\n", type, mode, repeat);
@@ -4264,24 +4522,19 @@ void Envelope_Editor::sync_view(char l, char m, float z, bool o)
 // Piano keyboard widget
 void Piano::draw()
 {
+	if (damage() & D_RANGES)
+		ranges_valid = false;
 	if (damage() & FL_DAMAGE_ALL)
 	{
+		// draws the curves in velocity and realtime mode
 		draw_ranges();
-		switch (mode)
+		if (mode == KEYRANGE)
 		{
-			case KEYRANGE:
-				draw_piano();
-				// make sure we draw the transpose position
-				active_keys[72 - transpose[selected_transpose_layer]] = -1;
-				draw_highlights();
-				draw_case();
-				break;
-			case VELOCITY:
-				draw_curve(VELOCITY);
-				break;
-			case REALTIME:
-				draw_curve(REALTIME);
-				break;
+			draw_piano();
+			// make sure we draw the transpose position
+			active_keys[72 - transpose[selected_transpose_layer]] = -1;
+			draw_highlights();
+			draw_case();
 		}
 		return;
 	}
@@ -4585,7 +4838,7 @@ int Piano::handle(int ev)
 						if (mode == KEYRANGE)
 							damage(D_RANGES | D_HIGHLIGHT);
 						else
-							damage(FL_DAMAGE_ALL);
+							damage(FL_DAMAGE_ALL | D_RANGES);
 					}
 					// velocity setup
 
@@ -4667,6 +4920,65 @@ int Piano::handle(int ev)
 }
 
 void Piano::draw_ranges()
+{
+	unsigned int colors[3] =
+	{ Fl::get_color(FL_BACKGROUND_COLOR), Fl::get_color(FL_FOREGROUND_COLOR), Fl::get_color(FL_SELECTION_COLOR) };
+	if (ranges_mode != mode || ranges_eall != ui->eall || memcmp(colors, ranges_colors, sizeof(colors)))
+		ranges_valid = false;
+	// the area below the keyboard (ranges) and the keyboard itself (curves)
+	int X = keyboard_x0 - 10;
+	int Y = keyboard_y0 - 11;
+	int W = keyboard_w + 15;
+	int H = h_white + 131;
+	if (ranges_cache && (ranges_w != W || ranges_h != H))
+	{
+		fl_delete_offscreen(ranges_cache);
+		ranges_cache = 0;
+	}
+	if (!ranges_cache)
+	{
+		ranges_cache = fl_create_offscreen(W, H);
+		ranges_w = W;
+		ranges_h = H;
+		ranges_valid = false;
+	}
+	if (!ranges_valid)
+	{
+		// render with the area at the origin of the cache
+		translate(-X, -Y);
+		fl_begin_offscreen(ranges_cache);
+		render_ranges();
+		if (mode != KEYRANGE)
+			draw_curve(mode);
+		fl_end_offscreen();
+		translate(X, Y);
+		ranges_mode = mode;
+		ranges_eall = ui->eall;
+		memcpy(ranges_colors, colors, sizeof(colors));
+		ranges_valid = true;
+	}
+	fl_copy_offscreen(X, keyboard_y0 + h_white + 1, W, 119, ranges_cache, 0, h_white + 12);
+	if (mode != KEYRANGE)
+		fl_copy_offscreen(keyboard_x0, Y, keyboard_w + 1, 10 + h_white, ranges_cache, 10, 0);
+}
+
+// moves the keyboard, key and dragbox coordinates
+void Piano::translate(int dx, int dy)
+{
+	keyboard_x0 += dx;
+	keyboard_y0 += dy;
+	for (int i = 0; i < 128; i++)
+		taste_x0[i][0] += dx;
+	for (int m = 0; m < 3; m++)
+		for (int l = 0; l < 8; l++)
+			for (int t = 0; t < 4; t++)
+			{
+				dragbox[m][l][t][0] += dx;
+				dragbox[m][l][t][1] += dy;
+			}
+}
+
+void Piano::render_ranges()
 {
 	fl_push_clip(keyboard_x0 - 10, keyboard_y0 + h_white, keyboard_w + 15, 120);
 	fl_color(FL_BACKGROUND_COLOR);
@@ -4872,6 +5184,9 @@ void Piano::draw_highlights()
 	for (unsigned char key = 0; key < 128; key++)
 		if (active_keys[key] != 0)
 		{
+			// keys outside the damaged region are left for a later draw
+			if (!fl_not_clipped(taste_x0[key][0], keyboard_y0, taste_x0[key][1] ? w_black : w_white, h_white))
+				continue;
 			if (taste_x0[key][1] == 1) // black key
 			{
 				if (key == 72 - transpose[selected_transpose_layer] && active_keys[key] == -1)
@@ -5099,6 +5414,12 @@ void Piano::calc_hovered(int x, int y)
 	previous_hovered_key = hovered_key;
 }
 
+Piano::~Piano()
+{
+	if (ranges_cache)
+		fl_delete_offscreen(ranges_cache);
+}
+
 void Piano::select_transpose_layer(char l)
 {
 	active_keys[72 - transpose[selected_transpose_layer]] = -1;
@@ -5132,7 +5453,16 @@ void Piano::activate_key(char value, unsigned char key)
 	else if (active_keys[key] < 1)
 		active_keys[key] = -1;
 	if (visible_r() && mode == KEYRANGE)
-		damage(D_HIGHLIGHT);
+		damage_key(key);
+}
+
+// damage the rectangle of a single key
+void Piano::damage_key(int key)
+{
+	if (taste_x0[key][1] == 1) // black key
+		damage(D_HIGHLIGHT, taste_x0[key][0], keyboard_y0, w_black, h_black);
+	else
+		damage(D_HIGHLIGHT, taste_x0[key][0], keyboard_y0, w_white, h_white);
 }
 
 void Piano::reset_active_keys()
@@ -5152,6 +5482,10 @@ void Piano::set_range_values(unsigned char md, unsigned char layer, unsigned cha
 		low_f = 0;
 	if (high_k - high_f < 0)
 		high_f = 0;
+	bool changed = prev_key_value[md][layer][LOW_KEY] != low_k || prev_key_value[md][layer][LOW_FADE] != low_f
+			|| prev_key_value[md][layer][HIGH_KEY] != high_k || prev_key_value[md][layer][HIGH_FADE] != high_f
+			|| new_key_value[md][layer][LOW_KEY] != low_k || new_key_value[md][layer][LOW_FADE] != low_f
+			|| new_key_value[md][layer][HIGH_KEY] != high_k || new_key_value[md][layer][HIGH_FADE] != high_f;
 	dragbox[md][layer][LOW_KEY][0] = taste_x0[low_k][0];
 	dragbox[md][layer][LOW_FADE][0] = taste_x0[low_k + low_f][0];
 	dragbox[md][layer][HIGH_KEY][0] = taste_x0[high_k][0];
@@ -5170,6 +5504,9 @@ void Piano::set_range_values(unsigned char md, unsigned char layer, unsigned cha
 	new_key_value[md][layer][LOW_FADE] = low_f;
 	new_key_value[md][layer][HIGH_KEY] = high_k;
 	new_key_value[md][layer][HIGH_FADE] = high_f;
+	if (!changed)
+		return;
+	ranges_valid = false;
 	if (visible_r())
 		damage(D_RANGES);
 }
@@ -5294,6 +5631,9 @@ void MiniPiano::draw_highlights()
 		if (active_keys[key] != 0)
 		{
 			int mapped_key = key - octave * 12;
+			// keys outside the damaged region are left for a later draw
+			if (!fl_not_clipped(taste_x0[mapped_key][0], key_y, taste_x0[key][1] ? w_black : w_white, h_white))
+				continue;
 			if (taste_x0[key][1] == 1) // black key
 			{
 				if (active_keys[key] == 2)
@@ -5694,9 +6034,19 @@ void MiniPiano::activate_key(int value, int key)
 		active_keys[key] = 3;
 	else if (active_keys[key] < 1)
 		active_keys[key] = -1;
-	if (key > 12 * octave + 24 || key < 12 * octave)
+	if (key > 12 * octave + 24 || key < 12 * octave || !visible_r())
 		return;
-	damage(D_HIGHLIGHT);
+	damage_key(key);
+}
+
+// damage the rectangle of a single key (rounded out, our coordinates are floats)
+void MiniPiano::damage_key(int key)
+{
+	int mapped_key = key - octave * 12;
+	if (taste_x0[key][1] == 1) // black key
+		damage(D_HIGHLIGHT, taste_x0[mapped_key][0] - 1, key_y - 1, w_black + 3, h_black + 3);
+	else
+		damage(D_HIGHLIGHT, taste_x0[mapped_key][0] - 1, key_y - 1, w_white + 1, h_white + 3);
 }
 
 void MiniPiano::reset_active_keys()
@@ -6010,3 +6360,304 @@ void Text_Display::resize(int X, int Y, int W, int H)
 		wrap_mode(1, W / c_w - 4);
 	Fl_Text_Display::resize(X, Y, W, H);
 }
+
+// ###################
+//
+// ###################
+Log_Display::Log_Display(int x, int y, int w, int h, char const* label) :
+		Fl_Group(x, y, w, h, label)
+{
+	traffic = 0;
+	text_color = FL_FOREGROUND_COLOR;
+	row_base = first_serial = top = 0;
+	sel_anchor = sel_end = -1;
+	update_pending = update_follow = false;
+	scrollbar = new Fl_Scrollbar(x + w - Fl::scrollbar_size(), y, Fl::scrollbar_size(), h);
+	scrollbar->callback(cb_scrollbar, this);
+	end();
+	fl_font(FL_COURIER, 12);
+	c_w = fl_width("w");
+	l_h = fl_height();
+	columns = (w - Fl::scrollbar_size() - 8) / c_w;
+	if (columns < 8)
+		columns = 8;
+}
+
+Log_Display::~Log_Display()
+{
+	Fl::remove_timeout(cb_update, this);
+}
+
+void Log_Display::cb_scrollbar(Fl_Widget*, void* p)
+{
+	Log_Display* d = (Log_Display*) p;
+	d->top = d->row_base + d->scrollbar->value();
+	d->redraw();
+}
+
+void Log_Display::source(Traffic_Log* log)
+{
+	traffic = log;
+	rebuild();
+}
+
+int Log_Display::rows_visible() const
+{
+	int rows = (h() - Fl::box_dh(box())) / l_h;
+	return rows > 0 ? rows : 1;
+}
+
+unsigned long Log_Display::rows_of(size_t record) const
+{
+	size_t len = traffic->text_length(record);
+	return len ? (len + columns - 1) / columns : 1;
+}
+
+void Log_Display::sync()
+{
+	if (!traffic)
+		return;
+	unsigned long first = traffic->first();
+	// dropped records
+	while (!row_end.empty() && first_serial < first)
+	{
+		row_base = row_end.front();
+		row_end.pop_front();
+		++first_serial;
+	}
+	if (row_end.empty())
+		first_serial = first;
+	// added records
+	for (size_t k = row_end.size(); k < traffic->size(); k++)
+		row_end.push_back((row_end.empty() ? row_base : row_end.back()) + rows_of(k));
+	if (top < row_base)
+		top = row_base;
+}
+
+void Log_Display::rebuild()
+{
+	// keep the top record in view
+	size_t top_record = std::upper_bound(row_end.begin(), row_end.end(), top) - row_end.begin();
+	row_end.clear();
+	row_base = top = 0;
+	first_serial = traffic ? traffic->first() : 0;
+	sync();
+	if (top_record > 0 && top_record <= row_end.size())
+		top = row_end[top_record - 1];
+	update_scrollbar();
+}
+
+void Log_Display::update_scrollbar()
+{
+	unsigned long end = row_end.empty() ? row_base : row_end.back();
+	unsigned long visible = rows_visible();
+	if (top + visible > end)
+		top = end > row_base + visible ? end - visible : row_base;
+	scrollbar->value(top - row_base, visible, 0, end - row_base);
+}
+
+void Log_Display::changed(bool follow)
+{
+	update_follow |= follow;
+	if (update_pending)
+		return;
+	update_pending = true;
+	// same frame rate as the scope
+	Fl::add_timeout(1.0 / FL_SCOPE_FRAME_RATE, cb_update, this);
+}
+
+void Log_Display::cb_update(void* p)
+{
+	Log_Display* d = (Log_Display*) p;
+	d->update_pending = false;
+	d->sync();
+	if (d->update_follow)
+		d->top = (unsigned long) -1 / 2;
+	d->update_follow = false;
+	d->update_scrollbar();
+	d->redraw();
+}
+
+void Log_Display::scroll(long rows)
+{
+	long t = (long) (top - row_base) + rows;
+	top = row_base + (t > 0 ? t : 0);
+	update_scrollbar();
+	redraw();
+}
+
+long Log_Display::record_at(int Y) const
+{
+	if (row_end.empty())
+		return -1;
+	int r = (Y - y() - Fl::box_dy(box())) / l_h;
+	unsigned long row = top + (r > 0 ? r : 0);
+	size_t k = std::upper_bound(row_end.begin(), row_end.end(), row) - row_end.begin();
+	if (k >= row_end.size())
+		k = row_end.size() - 1;
+	return (long) (first_serial + k);
+}
+
+void Log_Display::copy_selection(int clipboard) const
+{
+	if (!traffic || sel_anchor < 0)
+		return;
+	long a = sel_anchor < sel_end ? sel_anchor : sel_end;
+	long b = sel_anchor < sel_end ? sel_end : sel_anchor;
+	std::string text;
+	for (long serial = a; serial <= b; serial++)
+	{
+		if (serial < (long) first_serial || serial - (long) first_serial >= (long) row_end.size())
+			continue;
+		text += traffic->text(serial - first_serial);
+		text += '\n';
+	}
+	if (text.empty())
+		return;
+	Fl::copy(text.c_str(), text.size(), clipboard);
+}
+
+void Log_Display::resize(int X, int Y, int W, int H)
+{
+	Fl_Widget::resize(X, Y, W, H);
+	scrollbar->resize(X + W - Fl::box_dx(box()) - Fl::scrollbar_size(), Y + Fl::box_dy(box()), Fl::scrollbar_size(),
+			H - Fl::box_dh(box()));
+	int c = (W - Fl::box_dw(box()) - Fl::scrollbar_size() - 8) / c_w;
+	if (c < 8)
+		c = 8;
+	if (c != columns)
+	{
+		columns = c;
+		rebuild();
+	}
+	else
+		update_scrollbar();
+}
+
+int Log_Display::handle(int event)
+{
+	switch (event)
+	{
+		case FL_MOUSEWHEEL:
+			if (!Fl::event_dy())
+				break;
+			scroll(3 * Fl::event_dy());
+			return 1;
+		case FL_PUSH:
+			if (Fl::event_x() >= scrollbar->x() || Fl::event_button() != FL_LEFT_MOUSE)
+				break;
+			take_focus();
+			sel_end = record_at(Fl::event_y());
+			// shift extends the selection
+			if (!(Fl::event_state() & FL_SHIFT) || sel_anchor < 0)
+				sel_anchor = sel_end;
+			redraw();
+			return 1;
+		case FL_DRAG:
+			if (sel_anchor < 0)
+				break;
+			// scroll along when dragging out of view
+			if (Fl::event_y() < y())
+				scroll(-1);
+			else if (Fl::event_y() > y() + h())
+				scroll(1);
+			sel_end = record_at(Fl::event_y());
+			redraw();
+			return 1;
+		case FL_RELEASE:
+			if (sel_anchor < 0)
+				break;
+			copy_selection(0); // primary selection (X11)
+			return 1;
+		case FL_FOCUS:
+		case FL_UNFOCUS:
+			return 1;
+		case FL_KEYBOARD:
+		{
+			int page = rows_visible() - 1;
+			switch (Fl::event_key())
+			{
+				case FL_Up:
+					scroll(-1);
+					return 1;
+				case FL_Down:
+					scroll(1);
+					return 1;
+				case FL_Page_Up:
+					scroll(-page);
+					return 1;
+				case FL_Page_Down:
+					scroll(page);
+					return 1;
+				case FL_Home:
+					top = row_base;
+					update_scrollbar();
+					redraw();
+					return 1;
+				case FL_End:
+					scroll((long) (row_end.empty() ? 0 : row_end.back() - row_base));
+					return 1;
+			}
+			if (Fl::event_state() & (FL_CTRL | FL_COMMAND))
+			{
+				if (Fl::event_key() == 'c')
+				{
+					copy_selection(1);
+					return 1;
+				}
+				if (Fl::event_key() == 'a' && !row_end.empty())
+				{
+					sel_anchor = (long) first_serial;
+					sel_end = (long) (first_serial + row_end.size() - 1);
+					redraw();
+					return 1;
+				}
+			}
+			break;
+		}
+	}
+	return Fl_Group::handle(event);
+}
+
+void Log_Display::draw()
+{
+	// records added since the last frame
+	sync();
+	draw_box();
+	int X = x() + Fl::box_dx(box()) + 4;
+	int Y = y() + Fl::box_dy(box());
+	fl_push_clip(X - 4, Y, w() - Fl::box_dw(box()) - Fl::scrollbar_size(), h() - Fl::box_dh(box()));
+	fl_font(FL_COURIER, 12);
+	long sel_a = sel_anchor < sel_end ? sel_anchor : sel_end;
+	long sel_b = sel_anchor < sel_end ? sel_end : sel_anchor;
+	unsigned long last = top + rows_visible();
+	unsigned long row = top;
+	// render the records in view only
+	while (row < last)
+	{
+		size_t k = std::upper_bound(row_end.begin(), row_end.end(), row) - row_end.begin();
+		if (k >= row_end.size())
+			break;
+		unsigned long start = k ? row_end[k - 1] : row_base;
+		std::string text = traffic->text(k);
+		long serial = (long) (first_serial + k);
+		bool selected = sel_anchor >= 0 && serial >= sel_a && serial <= sel_b;
+		for (; row < row_end[k] && row < last; row++)
+		{
+			if (selected)
+			{
+				fl_color(selection_color());
+				fl_rectf(X - 4, Y + (row - top) * l_h, w() - Fl::box_dw(box()) - Fl::scrollbar_size(), l_h);
+				fl_color(fl_contrast(text_color, selection_color()));
+			}
+			else
+				fl_color(text_color);
+			size_t offset = (row - start) * columns;
+			if (offset < text.size())
+				fl_draw(text.c_str() + offset, text.size() - offset < (size_t) columns ? text.size() - offset : columns, X,
+						Y + (row - top) * l_h + l_h - fl_descent());
+		}
+	}
+	fl_pop_clip();
+	draw_child(*scrollbar);
+}